@@ -0,0 +1,344 @@
+#!/usr/bin/env python
+# Copyright (C) 2011 by Kenneth Waters
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+
+"""Benchmarks for the exact cover solver.
+
+Every instance is built deterministically, and is run in a child process of
+its own so that its peak memory can be measured.  For each one we record, as
+JSON:
+  - construct: seconds to build the Coverings object from the rows.
+  - first: seconds to the first covering.
+  - all: seconds to enumerate every covering, or null if the instance has
+    too many to enumerate.
+  - solutions: the number of coverings enumerated, or 1 if only the first
+    was looked for.  The run fails if it is not the known count.
+  - nodes_per_sec: search steps per second over the longest run.
+  - peak_rss_kb: peak resident memory of the child process.
+
+Run 'python benchmark.py' or 'python setup.py benchmark'.
+
+"""
+import json
+import optparse
+import subprocess
+import sys
+import time
+
+try:
+    import resource
+except ImportError:
+    resource = None
+
+# Hard 9x9 puzzles, each with a unique solution.
+hard_sudokus = [
+    ('inkala-2012', '8..........36......7..9.2...5...7.......457.....1...3...'
+                    '1....68..85...1..9....4..'),
+    ('escargot', '1....7.9..3..2...8..96..5....53..9...1..8...26....4...3....'
+                 '..1..4......7..7...3..'),
+    ('easter-monster', '1.......2.9.4...5...6...7...5.9.3.......7.......85..'
+                       '4.7.....6...3...9.8...2.....1'),
+]
+
+
+def sudoku(puzzle, box):
+    """Rows for a sudoku of box x box boxes.
+
+    puzzle lists the cells row by row, '.' for empty, or is None for an empty
+    grid.  Symbols are numbered from 1.
+
+    """
+    n = box * box
+    rows = []
+    for y in range(n):
+        for x in range(n):
+            given = puzzle and puzzle[y * n + x]
+            for c in range(1, n + 1):
+                if given and given != '.' and int(given, 36) != c:
+                    continue
+                b = (y // box) * box + x // box
+                rows.append([('p', y, x), ('r', y, c), ('c', x, c),
+                             ('b', b, c)])
+    return rows
+
+
+def pentominos():
+    """The twelve pentominos, as lists of cells."""
+    return {
+        'f': [(1, 0), (2, 0), (0, 1), (1, 1), (1, 2)],
+        'i': [(0, 0), (0, 1), (0, 2), (0, 3), (0, 4)],
+        'l': [(0, 0), (0, 1), (0, 2), (0, 3), (1, 3)],
+        'n': [(1, 0), (1, 1), (0, 2), (1, 2), (0, 3)],
+        'p': [(0, 0), (1, 0), (0, 1), (1, 1), (0, 2)],
+        't': [(0, 0), (1, 0), (2, 0), (1, 1), (1, 2)],
+        'u': [(0, 0), (2, 0), (0, 1), (1, 1), (2, 1)],
+        'v': [(0, 0), (0, 1), (0, 2), (1, 2), (2, 2)],
+        'w': [(0, 0), (0, 1), (1, 1), (1, 2), (2, 2)],
+        'x': [(1, 0), (0, 1), (1, 1), (2, 1), (1, 2)],
+        'y': [(1, 0), (0, 1), (1, 1), (1, 2), (1, 3)],
+        'z': [(0, 0), (1, 0), (1, 1), (1, 2), (2, 2)],
+    }
+
+
+def tetrominos():
+    """The five free tetrominos, as lists of cells."""
+    return {
+        'I': [(0, 0), (0, 1), (0, 2), (0, 3)],
+        'L': [(0, 0), (0, 1), (0, 2), (1, 2)],
+        'O': [(0, 0), (1, 0), (0, 1), (1, 1)],
+        'S': [(1, 0), (2, 0), (0, 1), (1, 1)],
+        'T': [(0, 0), (1, 0), (2, 0), (1, 1)],
+    }
+
+
+def orientations(shape):
+    """List the distinct rotations and reflections of a polyomino."""
+    out = []
+    for i in range(8):
+        cells = shape
+        if i & 1:
+            cells = [(-x, y) for x, y in cells]
+        if i & 2:
+            cells = [(x, -y) for x, y in cells]
+        if i & 4:
+            cells = [(y, x) for x, y in cells]
+        mx = min(x for x, y in cells)
+        my = min(y for x, y in cells)
+        cells = sorted((x - mx, y - my) for x, y in cells)
+        if cells not in out:
+            out.append(cells)
+    return out
+
+
+def placements(pieces, board):
+    """Rows placing each named piece on the set of cells board."""
+    width = max(x for x, y in board) + 1
+    height = max(y for x, y in board) + 1
+    rows = []
+    for name in sorted(pieces):
+        for shape in orientations(pieces[name]):
+            for y0 in range(height):
+                for x0 in range(width):
+                    cells = [(x0 + x, y0 + y) for x, y in shape]
+                    if all(cell in board for cell in cells):
+                        rows.append([name] + sorted(cells))
+    return rows
+
+
+def scott(width, height):
+    """Dana Scott's pentomino problem on a width x height board.
+
+    An 8x8 board has its four center squares removed.
+
+    """
+    board = set((x, y) for x in range(width) for y in range(height))
+    if width == height == 8:
+        board -= set([(3, 3), (3, 4), (4, 3), (4, 4)])
+    return placements(pentominos(), board)
+
+
+def packing(width, height):
+    """Pack the five tetrominos into a width x height box.
+
+    The cells of the box are secondary, so they need not all be filled.
+
+    """
+    board = set((x, y) for x in range(width) for y in range(height))
+    return placements(tetrominos(), board), sorted(board)
+
+
+def queens(n):
+    """N-queens, with the diagonals secondary."""
+    rows = []
+    for r in range(n):
+        for c in range(n):
+            rows.append([('r', r), ('c', c), ('a', r + c), ('b', r - c)])
+    secondary = ([('a', i) for i in range(2 * n - 1)] +
+                 [('b', i) for i in range(1 - n, n)])
+    return rows, secondary
+
+
+def langford(n):
+    """Langford pairs: place two copies of each of 1..n in 2n slots so that
+    the copies of k have k numbers between them."""
+    rows = []
+    for k in range(1, n + 1):
+        for i in range(2 * n - k - 1):
+            rows.append([k, ('s', i), ('s', i + k + 1)])
+    return rows
+
+
+# Known numbers of coverings, counting every rotation and reflection.
+pentomino_counts = {'8x8': 520, '5x12': 4040, '6x10': 9356}
+queens_counts = {8: 92, 10: 724, 12: 14200}
+langford_counts = {7: 52, 8: 300, 11: 35584}
+packing_counts = {'4x5': 0, '5x5': 12760, '4x6': 4056}
+
+
+def instances(quick):
+    """List the benchmark instances as (family, name, enumerate all,
+    expected solutions)."""
+    out = []
+    for name, puzzle in hard_sudokus:
+        out.append(('sudoku', name, True, 1))
+    out.append(('sudoku', 'empty-16x16', False, 1))
+    if not quick:
+        out.append(('sudoku', 'empty-25x25', False, 1))
+    for size in ('8x8',) if quick else ('8x8', '5x12', '6x10'):
+        out.append(('pentomino', size, True, pentomino_counts[size]))
+    for n in (8, 10) if quick else (8, 10, 12):
+        out.append(('queens', str(n), True, queens_counts[n]))
+    out.append(('queens', '48', False, 1))
+    for n in (7, 8) if quick else (7, 8, 11):
+        out.append(('langford', str(n), True, langford_counts[n]))
+    for size in ('4x5', '5x5') if quick else ('4x5', '5x5', '4x6'):
+        out.append(('packing', size, True, packing_counts[size]))
+    return out
+
+
+def build(family, name):
+    """Return the rows and Coverings keyword arguments of an instance."""
+    if family == 'sudoku':
+        puzzles = dict(hard_sudokus)
+        if name in puzzles:
+            return sudoku(puzzles[name], 3), {}
+        box = int(name.split('x')[-1]) ** 0.5
+        return sudoku(None, int(round(box))), {}
+    if family == 'pentomino':
+        width, height = map(int, name.split('x'))
+        return scott(width, height), {}
+    if family == 'queens':
+        rows, secondary = queens(int(name))
+        return rows, {'secondary': secondary}
+    if family == 'langford':
+        return langford(int(name)), {}
+    if family == 'packing':
+        width, height = map(int, name.split('x'))
+        rows, secondary = packing(width, height)
+        return rows, {'secondary': secondary}
+    raise ValueError('unknown family %r' % family)
+
+
+def peak_rss_kb():
+    """Peak resident memory of this process in kilobytes, or None."""
+    if resource is None:
+        return None
+    peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    # ru_maxrss is in bytes on Mac OS X, kilobytes elsewhere.
+    if sys.platform == 'darwin':
+        peak //= 1024
+    return peak
+
+
+def measure(family, name, enumerate_all):
+    """Run one instance and return its measurements as a dict."""
+    import exactcover
+
+    rows, kwds = build(family, name)
+
+    start = time.time()
+    coverings = exactcover.Coverings(rows, **kwds)
+    construct = time.time() - start
+
+    start = time.time()
+    first = next(coverings, None)
+    first_time = time.time() - start
+    nodes, seconds = coverings.nodes, first_time
+
+    all_time = None
+    count = first is not None and 1 or 0
+    if enumerate_all:
+        coverings = exactcover.Coverings(rows, **kwds)
+        start = time.time()
+        count = sum(1 for covering in coverings)
+        all_time = time.time() - start
+        nodes, seconds = coverings.nodes, all_time
+
+    return {
+        'family': family,
+        'instance': name,
+        'rows': len(rows),
+        'construct': construct,
+        'first': first_time,
+        'all': all_time,
+        'solutions': count,
+        'nodes': nodes,
+        'nodes_per_sec': seconds and nodes / seconds or None,
+        'peak_rss_kb': peak_rss_kb(),
+    }
+
+
+def run(family, name, enumerate_all, expected):
+    """Measure an instance in a child process, and check it found the
+    expected number of coverings."""
+    args = [sys.executable, __file__, '--child', family, name]
+    if enumerate_all:
+        args.append('--all')
+    child = subprocess.Popen(args, stdout=subprocess.PIPE)
+    output = child.communicate()[0]
+    if child.returncode != 0:
+        raise RuntimeError('%s %s failed' % (family, name))
+    result = json.loads(output.decode('ascii'))
+    if result['solutions'] != expected:
+        raise RuntimeError('%s %s found %d coverings, expected %d' % (
+            family, name, result['solutions'], expected))
+    return result
+
+
+def main(argv=None):
+    parser = optparse.OptionParser(usage='%prog [options] [family ...]')
+    parser.add_option('-o', '--output', help='write the JSON to FILE',
+                      metavar='FILE')
+    parser.add_option('-q', '--quick', action='store_true',
+                      help='only run the smaller instances')
+    parser.add_option('--child', action='store_true',
+                      help=optparse.SUPPRESS_HELP)
+    parser.add_option('--all', action='store_true',
+                      help=optparse.SUPPRESS_HELP)
+    options, args = parser.parse_args(argv)
+
+    if options.child:
+        family, name = args
+        json.dump(measure(family, name, options.all), sys.stdout)
+        return 0
+
+    results = []
+    for family, name, enumerate_all, expected in instances(options.quick):
+        if args and family not in args:
+            continue
+        result = run(family, name, enumerate_all, expected)
+        sys.stderr.write('%-10s %-14s %10.4fs %10.4fs %s\n' % (
+            family, name, result['construct'], result['first'],
+            result['all'] is None and '-' or '%.4fs' % result['all']))
+        results.append(result)
+
+    text = json.dumps({'python': sys.version.split()[0],
+                       'results': results}, indent=2, sort_keys=True)
+    if options.output:
+        out = open(options.output, 'w')
+        out.write(text + '\n')
+        out.close()
+    else:
+        sys.stdout.write(text + '\n')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,339 @@
+/* Copyright (C) 2011 by Kenneth Waters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE. */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dlx.h"
+#include "dlxlinks.h"
+
+struct DlxMatrixRec
+{
+    /* Primary columns are linked from corner, secondary ones from secondary.
+     * The headers of both are in columns, by item number. */
+    Header corner;
+    Header secondary;
+    Header *columns;
+    int primary;
+    int itemCount;
+
+    /* The first element of each row, by row number; NULL for an empty row. */
+    Element **rows;
+    int rowCount;
+    int rowCapacity;
+
+    /* The rows chosen so far, and their numbers for the caller.  No more than
+     * one row per primary column is ever chosen. */
+    Element **solution;
+    int *numbers;
+    int solutionSize;
+
+    int first;
+    int done;
+    unsigned long nodes;
+
+    /* Everything the matrix allocates, itself included, comes from these. */
+    dlx_alloc_fn alloc;
+    dlx_release_fn release;
+};
+
+/* Make column an empty header. */
+static void
+init_header(Header *column)
+{
+    column->e.up = &column->e;
+    column->e.down = &column->e;
+    column->e.left = &column->e;
+    column->e.right = &column->e;
+    column->e.column = column;
+    column->e.row = -1;
+    column->e.color = 0;
+    column->e.object = NULL;
+    column->count = 0;
+    column->object = NULL;
+    column->index = -1;
+    column->purifier = NULL;
+    column->bound = 1;
+    column->slack = 0;
+    column->weight = 1;
+    column->priority = 0;
+}
+
+/* Append column to the header chain of corner. */
+static void
+append_header(Header *corner, Header *column)
+{
+    column->e.right = &corner->e;
+    column->e.left = corner->e.left;
+    corner->e.left->right = &column->e;
+    corner->e.left = &column->e;
+}
+
+dlx_matrix *
+dlx_new(int primary, int secondary, dlx_alloc_fn alloc,
+        dlx_release_fn release)
+{
+    dlx_matrix *m;
+    int i;
+
+    if (primary < 0 || secondary < 0)
+        return NULL;
+    if (!alloc || !release) {
+        alloc = malloc;
+        release = free;
+    }
+    m = (dlx_matrix *)alloc(sizeof(dlx_matrix));
+    if (!m)
+        return NULL;
+    memset(m, 0, sizeof(dlx_matrix));
+    m->alloc = alloc;
+    m->release = release;
+    m->primary = primary;
+    m->itemCount = primary + secondary;
+    m->first = 1;
+
+    m->columns = (Header *)m->alloc((m->itemCount + 1) * sizeof(Header));
+    m->solution = (Element **)m->alloc((primary + 1) * sizeof(Element *));
+    m->numbers = (int *)m->alloc((primary + 1) * sizeof(int));
+    if (!m->columns || !m->solution || !m->numbers) {
+        dlx_free(m);
+        return NULL;
+    }
+
+    init_header(&m->corner);
+    init_header(&m->secondary);
+    for (i = 0; i < m->itemCount; i++) {
+        Header *column = &m->columns[i];
+        init_header(column);
+        column->index = i;
+        if (i < primary) {
+            append_header(&m->corner, column);
+        } else {
+            column->bound = -1;
+            append_header(&m->secondary, column);
+        }
+    }
+    return m;
+}
+
+void
+dlx_free(dlx_matrix *m)
+{
+    Element *e;
+    Element *next_e;
+    int i;
+
+    if (!m)
+        return;
+    for (i = 0; i < m->rowCount; i++) {
+        if (!m->rows[i])
+            continue;
+        m->rows[i]->left->right = NULL;
+        for (e = m->rows[i]; e; e = next_e) {
+            next_e = e->right;
+            m->release(e);
+        }
+    }
+    if (m->rows)
+        m->release(m->rows);
+    if (m->columns)
+        m->release(m->columns);
+    if (m->solution)
+        m->release(m->solution);
+    if (m->numbers)
+        m->release(m->numbers);
+    m->release(m);
+}
+
+int
+dlx_add_row(dlx_matrix *m, const int *items, const int *colors, int count)
+{
+    Element *row = NULL;
+    int i, j;
+
+    if (!m->first || count < 0)
+        return -1;
+    for (i = 0; i < count; i++) {
+        if (items[i] < 0 || items[i] >= m->itemCount)
+            return -1;
+        if (colors && (colors[i] < 0 ||
+                       (colors[i] && items[i] < m->primary)))
+            return -1;
+        for (j = 0; j < i; j++) {
+            if (items[j] == items[i])
+                return -1;
+        }
+    }
+
+    if (m->rowCount == m->rowCapacity) {
+        int capacity = m->rowCapacity ? 2 * m->rowCapacity : 64;
+        Element **rows =
+            (Element **)m->alloc(capacity * sizeof(Element *));
+        if (!rows)
+            return -1;
+        if (m->rows) {
+            memcpy(rows, m->rows, m->rowCount * sizeof(Element *));
+            m->release(m->rows);
+        }
+        m->rows = rows;
+        m->rowCapacity = capacity;
+    }
+
+    for (i = 0; i < count; i++) {
+        Element *e = (Element *)m->alloc(sizeof(Element));
+        if (!e) {
+            /* Unlink what was added of the row, and free it. */
+            while (row) {
+                Element *last = row->left;
+                last->up->down = last->down;
+                last->down->up = last->up;
+                last->column->count--;
+                if (last == row) {
+                    row = NULL;
+                } else {
+                    last->left->right = row;
+                    row->left = last->left;
+                }
+                m->release(last);
+            }
+            return -1;
+        }
+        e->column = &m->columns[items[i]];
+        e->row = m->rowCount;
+        e->color = colors ? colors[i] : 0;
+        e->object = NULL;
+
+        /* Append to the bottom of the column. */
+        e->down = &e->column->e;
+        e->up = e->column->e.up;
+        e->column->e.up->down = e;
+        e->column->e.up = e;
+        e->column->count++;
+
+        /* Append to the row. */
+        if (!row) {
+            row = e;
+            e->left = e;
+            e->right = e;
+        } else {
+            e->right = row;
+            e->left = row->left;
+            row->left->right = e;
+            row->left = e;
+        }
+    }
+
+    m->rows[m->rowCount] = row;
+    return m->rowCount++;
+}
+
+/* Make one solving step, returning 1 at a covering, -1 if the search must
+ * back up, or 0 to go on. */
+static int
+dlx_step(dlx_matrix *m)
+{
+    Header *column = smallest_column(&m->corner);
+    Element *row;
+
+    m->nodes++;
+    if (!column)
+        return 1;
+    if (column->count == 0)
+        return -1;
+
+    row = column->e.down;
+    unlink_row(row);
+    CHECK(&m->corner);
+    m->solution[m->solutionSize++] = row;
+    return 0;
+}
+
+/* Move on to the next row at the deepest level left.  Returns -1 if there
+ * are no more. */
+static int
+dlx_backup(dlx_matrix *m)
+{
+    while (m->solutionSize > 0) {
+        Element *row = m->solution[m->solutionSize - 1];
+        link_row(row);
+        CHECK(&m->corner);
+        row = row->down;
+        if (row == &row->column->e) {
+            m->solutionSize--;
+        } else {
+            unlink_row(row);
+            CHECK(&m->corner);
+            m->solution[m->solutionSize - 1] = row;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int
+dlx_next(dlx_matrix *m, const int **rows)
+{
+    int i;
+
+    if (m->done)
+        return -1;
+    if (m->first)
+        m->first = 0;
+    else if (dlx_backup(m) < 0)
+        goto done;
+
+    for (;;) {
+        int action = dlx_step(m);
+        if (action > 0)
+            break;
+        if (action < 0 && dlx_backup(m) < 0)
+            goto done;
+    }
+
+    for (i = 0; i < m->solutionSize; i++)
+        m->numbers[i] = m->solution[i]->row;
+    *rows = m->numbers;
+    return m->solutionSize;
+
+done:
+    m->done = 1;
+    return -1;
+}
+
+long
+dlx_solve(dlx_matrix *m, dlx_visit visit, void *arg)
+{
+    const int *rows;
+    long count = 0;
+    int size;
+
+    while ((size = dlx_next(m, &rows)) >= 0) {
+        count++;
+        if (visit && visit(arg, rows, size))
+            break;
+    }
+    return count;
+}
+
+unsigned long
+dlx_nodes(const dlx_matrix *m)
+{
+    return m->nodes;
+}
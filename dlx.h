@@ -0,0 +1,83 @@
+/* Copyright (C) 2011 by Kenneth Waters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE. */
+
+/* Exact cover solver, as a C library.
+ *
+ * Items are numbered 0 .. primary + secondary - 1; the first primary of them
+ * must be covered exactly once, the rest at most once.  Rows are numbered in
+ * the order they are added.  An entry of a row in a secondary item may carry
+ * a color, greater than 0; rows agreeing on the color of an item may share it
+ * (Knuth's Algorithm C).
+ *
+ * Coverings are produced one at a time by dlx_next(), or passed to a callback
+ * by dlx_solve(), as arrays of row numbers. */
+
+#ifndef DLX_H
+#define DLX_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct DlxMatrixRec dlx_matrix;
+
+/* Called with each covering found by dlx_solve().  Returning non-zero stops
+ * the search. */
+typedef int (*dlx_visit)(void *arg, const int *rows, int count);
+
+/* An allocator, and the function to give its memory back. */
+typedef void *(*dlx_alloc_fn)(size_t size);
+typedef void (*dlx_release_fn)(void *p);
+
+/* Make an empty matrix.  Everything it allocates, for as long as it lives,
+ * comes from alloc and goes back through release; if either is NULL,
+ * malloc() and free() are used.  Returns NULL if out of memory. */
+dlx_matrix *dlx_new(int primary, int secondary, dlx_alloc_fn alloc,
+                    dlx_release_fn release);
+
+/* Free a matrix. */
+void dlx_free(dlx_matrix *m);
+
+/* Add a row of count items.  colors may be NULL, or give each entry's color,
+ * 0 for none.  Returns the row's number, or -1 if an item is out of range or
+ * repeated, a primary item is colored, the search has started, or out of
+ * memory. */
+int dlx_add_row(dlx_matrix *m, const int *items, const int *colors,
+                int count);
+
+/* Find the next covering.  Returns the number of rows in it, storing a
+ * pointer to them in *rows, valid until the next call; or -1 once there are
+ * no more. */
+int dlx_next(dlx_matrix *m, const int **rows);
+
+/* Pass every covering not yet returned by dlx_next() to visit.  Returns the
+ * number of coverings visited. */
+long dlx_solve(dlx_matrix *m, dlx_visit visit, void *arg);
+
+/* Number of search steps taken so far. */
+unsigned long dlx_nodes(const dlx_matrix *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DLX_H */
@@ -0,0 +1,333 @@
+/* Copyright (C) 2011 by Kenneth Waters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE. */
+
+/* Command line exact cover solver.
+ *
+ * The input is in the format of Knuth's DLX programs.  The first line names
+ * the items, primary ones first, then a '|' and the secondary ones.  Every
+ * line after that is a row, naming its items; an entry of a secondary item may
+ * give a color as item:color.  Lines starting with '|' are comments.
+ *
+ * Each covering is written as a line of row numbers, counting from 0, or with
+ * -r as the rows themselves followed by a blank line. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dlx.h"
+
+static const char usage[] =
+"usage: dlxcover [-c] [-r] [-s] [-n count] [file]\n"
+"  -c  only count the coverings\n"
+"  -r  print the rows of each covering rather than their numbers\n"
+"  -s  print statistics to stderr\n"
+"  -n  stop after count coverings\n";
+
+/* Open addressing table of names, numbered in order of insertion. */
+typedef struct {
+    char **names;
+    int *slots;
+    int count;
+    int capacity;
+    int slotCount;
+} Names;
+
+static unsigned long
+hash_name(const char *name)
+{
+    unsigned long h = 2166136261UL;
+
+    while (*name)
+        h = (h ^ (unsigned char)*name++) * 16777619UL;
+    return h;
+}
+
+/* Return the slot of name, which is -1 if it is not in the table. */
+static int *
+names_slot(Names *names, const char *name)
+{
+    unsigned long i = hash_name(name) & (names->slotCount - 1);
+
+    while (names->slots[i] >= 0 &&
+           strcmp(names->names[names->slots[i]], name))
+        i = (i + 1) & (names->slotCount - 1);
+    return &names->slots[i];
+}
+
+/* Return the number of name, adding it if add is set.  Returns -1 if it is
+ * not there, or -2 if out of memory. */
+static int
+names_find(Names *names, const char *name, int add)
+{
+    int *slot;
+    int i;
+
+    if (names->count * 2 >= names->slotCount) {
+        int *slots;
+        int slotCount = names->slotCount ? 2 * names->slotCount : 64;
+        if (!(slots = (int *)malloc(slotCount * sizeof(int))))
+            return -2;
+        free(names->slots);
+        names->slots = slots;
+        names->slotCount = slotCount;
+        for (i = 0; i < slotCount; i++)
+            slots[i] = -1;
+        for (i = 0; i < names->count; i++)
+            *names_slot(names, names->names[i]) = i;
+    }
+
+    slot = names_slot(names, name);
+    if (*slot >= 0 || !add)
+        return *slot;
+
+    if (names->count == names->capacity) {
+        int capacity = names->capacity ? 2 * names->capacity : 64;
+        char **grown = (char **)realloc(names->names,
+                                        capacity * sizeof(char *));
+        if (!grown)
+            return -2;
+        names->names = grown;
+        names->capacity = capacity;
+    }
+    names->names[names->count] = (char *)name;
+    *slot = names->count;
+    return names->count++;
+}
+
+/* Read all of f into a NUL terminated buffer. */
+static char *
+read_all(FILE *f)
+{
+    size_t size = 0;
+    size_t capacity = 65536;
+    char *buffer = (char *)malloc(capacity);
+    size_t n;
+
+    while (buffer && (n = fread(buffer + size, 1, capacity - size - 1, f))) {
+        size += n;
+        if (size + 1 == capacity) {
+            char *grown = (char *)realloc(buffer, capacity * 2);
+            if (!grown) {
+                free(buffer);
+                return NULL;
+            }
+            buffer = grown;
+            capacity *= 2;
+        }
+    }
+    if (buffer)
+        buffer[size] = '\0';
+    return buffer;
+}
+
+typedef struct {
+    int rowsText;
+    char **lines;
+    unsigned long limit;
+    unsigned long seen;
+} Output;
+
+/* dlx_visit for printing a covering. */
+static int
+print_covering(void *arg, const int *rows, int count)
+{
+    Output *out = (Output *)arg;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (out->rowsText)
+            printf("%s\n", out->lines[rows[i]]);
+        else
+            printf(i ? " %d" : "%d", rows[i]);
+    }
+    putchar('\n');
+    return out->limit && ++out->seen >= out->limit;
+}
+
+/* dlx_visit for counting. */
+static int
+count_covering(void *arg, const int *rows, int count)
+{
+    Output *out = (Output *)arg;
+
+    (void)rows;
+    (void)count;
+    return out->limit && ++out->seen >= out->limit;
+}
+
+int
+main(int argc, char **argv)
+{
+    Names items = { NULL, NULL, 0, 0, 0 };
+    Names colors = { NULL, NULL, 0, 0, 0 };
+    Output out = { 0, NULL, 0, 0 };
+    int countOnly = 0;
+    int stats = 0;
+    int primary = -1;
+    char *text;
+    char *line;
+    char *next;
+    char **lines = NULL;
+    int lineCount = 0;
+    int *rowItems = NULL;
+    int *rowColors = NULL;
+    dlx_matrix *m;
+    FILE *f = stdin;
+    clock_t start;
+    long found;
+    int i;
+
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1]; i++) {
+        if (!strcmp(argv[i], "-c")) {
+            countOnly = 1;
+        } else if (!strcmp(argv[i], "-r")) {
+            out.rowsText = 1;
+        } else if (!strcmp(argv[i], "-s")) {
+            stats = 1;
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            out.limit = strtoul(argv[++i], NULL, 10);
+        } else {
+            fputs(usage, stderr);
+            return 2;
+        }
+    }
+    if (i + 1 < argc) {
+        fputs(usage, stderr);
+        return 2;
+    }
+    if (i < argc && strcmp(argv[i], "-") && !(f = fopen(argv[i], "r"))) {
+        perror(argv[i]);
+        return 1;
+    }
+    if (!(text = read_all(f))) {
+        fputs("dlxcover: out of memory\n", stderr);
+        return 1;
+    }
+    if (f != stdin)
+        fclose(f);
+
+    /* Split the text into lines, skipping comments and blank lines. */
+    for (line = text; line; line = next) {
+        char *p;
+        if ((next = strchr(line, '\n')))
+            *next++ = '\0';
+        for (p = line; *p == ' ' || *p == '\t' || *p == '\r'; p++)
+            ;
+        if (!*p || *p == '|')
+            continue;
+        if (!(lineCount & (lineCount - 1))) {
+            char **grown = (char **)realloc(lines, (lineCount ? 2 * lineCount
+                                                    : 1) * sizeof(char *));
+            if (!grown) {
+                fputs("dlxcover: out of memory\n", stderr);
+                return 1;
+            }
+            lines = grown;
+        }
+        lines[lineCount++] = line;
+    }
+    if (lineCount == 0) {
+        fputs("dlxcover: no items\n", stderr);
+        return 1;
+    }
+
+    /* The item line.  Its names point into the text, which is kept. */
+    for (line = strtok(lines[0], " \t\r"); line;
+         line = strtok(NULL, " \t\r")) {
+        if (!strcmp(line, "|")) {
+            primary = items.count;
+            continue;
+        }
+        if (names_find(&items, line, 0) != -1) {
+            fprintf(stderr, "dlxcover: item %s repeated\n", line);
+            return 1;
+        }
+        if (names_find(&items, line, 1) < 0) {
+            fputs("dlxcover: out of memory\n", stderr);
+            return 1;
+        }
+    }
+    if (primary < 0)
+        primary = items.count;
+
+    m = dlx_new(primary, items.count - primary, NULL, NULL);
+    rowItems = (int *)malloc((items.count + 1) * sizeof(int));
+    rowColors = (int *)malloc((items.count + 1) * sizeof(int));
+    out.lines = (char **)malloc(lineCount * sizeof(char *));
+    if (!m || !rowItems || !rowColors || !out.lines) {
+        fputs("dlxcover: out of memory\n", stderr);
+        return 1;
+    }
+
+    start = clock();
+    for (i = 1; i < lineCount; i++) {
+        char *token;
+        int count = 0;
+
+        /* Tokenizing splits the line up, so keep a copy to print. */
+        if (out.rowsText) {
+            char *copy = (char *)malloc(strlen(lines[i]) + 1);
+            if (!copy) {
+                fputs("dlxcover: out of memory\n", stderr);
+                return 1;
+            }
+            out.lines[i - 1] = strcpy(copy, lines[i]);
+        }
+        for (token = strtok(lines[i], " \t\r"); token;
+             token = strtok(NULL, " \t\r")) {
+            char *color = strchr(token, ':');
+            if (count == items.count) {
+                count = -1;
+                break;
+            }
+            if (color)
+                *color++ = '\0';
+            rowItems[count] = names_find(&items, token, 0);
+            rowColors[count] = color ? names_find(&colors, color, 1) + 1 : 0;
+            if (rowItems[count] < 0 || rowColors[count] < 0) {
+                count = -1;
+                break;
+            }
+            count++;
+        }
+        if (count < 0 || dlx_add_row(m, rowItems, rowColors, count) < 0) {
+            fprintf(stderr, "dlxcover: bad row %d\n", i - 1);
+            return 1;
+        }
+    }
+    if (stats)
+        fprintf(stderr, "%d items, %d rows, built in %.3fs\n", items.count,
+                lineCount - 1, (double)(clock() - start) / CLOCKS_PER_SEC);
+
+    start = clock();
+    found = dlx_solve(m, countOnly ? count_covering : print_covering, &out);
+    if (countOnly)
+        printf("%ld\n", found);
+    if (stats) {
+        double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+        fprintf(stderr, "%ld coverings, %lu nodes in %.3fs\n", found,
+                dlx_nodes(m), seconds);
+    }
+
+    dlx_free(m);
+    return 0;
+}
@@ -0,0 +1,438 @@
+/* Copyright (C) 2011 by Kenneth Waters
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE. */
+
+/* The dancing links sparse matrix: its node layout and the operations the
+ * search is made of.  Shared by the C core in dlx.c and the Python module,
+ * which each drive their own search over it; nothing here depends on
+ * Python.  Everything is inline so the link loops compile into each
+ * search. */
+
+#ifndef DLXLINKS_H
+#define DLXLINKS_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#if defined(__GNUC__) || defined(_MSC_VER)
+#define DLX_INLINE static __inline
+#else
+#define DLX_INLINE static
+#endif
+
+/* #undef CHECK_INVARIANTS */
+
+typedef struct ElementRec Element;
+typedef struct HeaderRec Header;
+
+/* An element in the sparse matrix. */
+struct ElementRec
+{
+    Element *up;
+    Element *down;
+    Element *left;
+    Element *right;
+
+    Header *column;
+
+    /* Index of this element's row in the input. */
+    int row;
+
+    /* Color of a secondary column entry, or 0 if it must be exclusive. */
+    int color;
+
+    /* This row's payload.  If rows are <= 5 elements it's a win to keep a
+     * pointer in every element.  It also reduces complexity. */
+    void *object;
+};
+
+/* A header for a column in the sparse matrix.  Keeps track of a count of
+ * rows which have a '1' in this column. */
+struct HeaderRec
+{
+    Element e;
+
+    int count;
+    void *object;
+
+    /* Index of this column in creation order. */
+    int index;
+
+    /* For a secondary column, the element whose color it was purified to.
+     * Rows agreeing with it stay, all others are hidden. */
+    Element *purifier;
+
+    /* Number of further rows which may cover this column, and how many of
+     * those are optional.  A column is covered u..v times by starting with
+     * bound = v and slack = v - u.  Secondary columns have a bound of -1. */
+    int bound;
+    int slack;
+
+    /* Number of times, plus one, the search has found this column with no
+     * rows left.  Used by the weighted heuristic. */
+    unsigned long weight;
+
+    /* Rank of the column's user-supplied priority; lower goes first.  Breaks
+     * ties between columns, or leads with the priority heuristic. */
+    int priority;
+};
+
+/* ------------------------------------------------------------------------ *
+ * Sparse Matrix Representation                                             *
+ * ------------------------------------------------------------------------ */
+
+#if defined(CHECK_INVARIANTS) && !defined(NDEBUG)
+DLX_INLINE void
+check_row(Element *row)
+{
+    Element *e = row;
+    do {
+        assert(e->right->left == e);
+        assert(e->left->right == e);
+        e = e->right;
+    } while (e != row);
+}
+
+DLX_INLINE void
+check_column(Header *column)
+{
+    int count = 0;
+    Element *e = &column->e;
+    do {
+        assert(e->up->down = e);
+        assert(e->down->up = e);
+        assert(e->column = column);
+        check_row(e);
+        e = e->down;
+        count++;
+    } while (e != &column->e);
+    assert(column->count == count - 1);
+}
+
+DLX_INLINE void
+check(Header *corner)
+{
+    Element *e;
+
+    assert(corner->e.up == &corner->e);
+    assert(corner->e.down == &corner->e);
+
+    for (e = corner->e.right; e != &corner->e; e = e->right)
+    {
+        check_column((Header*)e);
+    }
+}
+#define CHECK(x) check(x)
+#else
+#define CHECK(x)
+#endif
+
+/* Non-zero if e sits in a purified column and agrees with its color.  Such
+ * elements are left in place when their row is hidden, so unpurify() can
+ * find them again. */
+#define MATCHED(e) ((e)->color && (e)->column->purifier && \
+                    (e)->column->purifier->color == (e)->color)
+
+/* Remove every element of row except row itself from its column. */
+DLX_INLINE void
+hide_row(Element *row)
+{
+    Element *e;
+
+    for (e = row->left; e != row; e = e->left) {
+        if (MATCHED(e))
+            continue;
+        e->column->count--;
+        e->up->down = e->down;
+        e->down->up = e->up;
+    }
+}
+
+/* Undo hide_row(). */
+DLX_INLINE void
+unhide_row(Element *row)
+{
+    Element *e;
+
+    for (e = row->right; e != row; e = e->right) {
+        if (MATCHED(e))
+            continue;
+        e->column->count++;
+        e->up->down = e;
+        e->down->up = e;
+    }
+}
+
+/* Remove a column and all rows with a '1' in that column from the matrix. */
+DLX_INLINE void
+unlink_column(Header *column)
+{
+    Element *row;
+
+    /* remove Header element */
+    column->e.left->right = column->e.right;
+    column->e.right->left = column->e.left;
+
+    /* remove rows */
+    for (row = column->e.up; row != &column->e; row = row->up)
+        hide_row(row);
+}
+
+/* Put a column back into the matrix.  Must be called in the exact reverse
+ * order of unlink_column(). */
+DLX_INLINE void
+link_column(Header *column)
+{
+    Element *row;
+
+    /* link Header element */
+    column->e.left->right = &column->e;
+    column->e.right->left = &column->e;
+
+    /* Add rows */
+    for (row = column->e.down; row != &column->e; row = row->down)
+        unhide_row(row);
+}
+
+/* Restrict a secondary column to the rows which agree with e's color
+ * (Knuth's Algorithm C).  The column stays in the matrix. */
+DLX_INLINE void
+purify(Element *e)
+{
+    Header *column = e->column;
+    Element *row;
+
+    column->purifier = e;
+    for (row = column->e.up; row != &column->e; row = row->up) {
+        if (row->color != e->color)
+            hide_row(row);
+    }
+}
+
+/* Undo purify(). */
+DLX_INLINE void
+unpurify(Element *e)
+{
+    Header *column = e->column;
+    Element *row;
+
+    for (row = column->e.down; row != &column->e; row = row->down) {
+        if (row->color != e->color)
+            unhide_row(row);
+    }
+    column->purifier = NULL;
+}
+
+/* Remove a row from the matrix. */
+DLX_INLINE void
+unlink_row(Element *row)
+{
+    Element *e = row;
+    do {
+        if (!e->color)
+            unlink_column(e->column);
+        else if (!e->column->purifier)
+            purify(e);
+        e = e->right;
+    } while (e != row);
+}
+
+/* Put a row back into the matrix.  Must be called in the exact reverse order
+ * of link_row(). */
+DLX_INLINE void
+link_row(Element *row)
+{
+    Element *e = row->left;
+    do {
+        if (!e->color)
+            link_column(e->column);
+        else if (e->column->purifier == e)
+            unpurify(e);
+        e = e->left;
+    } while (e != row->left);
+}
+
+/* Non-zero if row is still in the matrix, so it can be chosen. */
+DLX_INLINE int
+row_available(Element *row)
+{
+    Element *e = row;
+    do {
+        Header *column = e->column;
+        if (column->e.left->right != &column->e || e->up->down != e ||
+            (column->purifier && !MATCHED(e)))
+            return 0;
+        e = e->right;
+    } while (e != row);
+    return 1;
+}
+
+/* ------------------------------------------------------------------------ *
+ * Multiplicities                                                           *
+ * ------------------------------------------------------------------------ */
+
+/* These implement Knuth's Algorithm M, where a primary column may be covered
+ * a bounded number of times.  Rather than choosing a row and covering every
+ * column in it, each level of the search picks the next row for one column,
+ * or decides that column takes no more rows.  Rows passed over are hidden
+ * ("tweaked") until the level is backed out of, so every combination of rows
+ * is tried in a single order. */
+
+/* Take row out of the matrix completely, including row itself. */
+DLX_INLINE void
+remove_row(Element *row)
+{
+    hide_row(row);
+    row->column->count--;
+    row->up->down = row->down;
+    row->down->up = row->up;
+}
+
+/* Undo remove_row(). */
+DLX_INLINE void
+restore_row(Element *row)
+{
+    row->column->count++;
+    row->up->down = row;
+    row->down->up = row;
+    unhide_row(row);
+}
+
+/* Use row once for each of its columns.  Columns which reach their bound are
+ * covered. */
+DLX_INLINE void
+take_row(Element *row)
+{
+    Element *e = row;
+
+    remove_row(row);
+    do {
+        Header *column = e->column;
+        if (e->color) {
+            if (!column->purifier)
+                purify(e);
+        } else if (column->bound < 0 || --column->bound == 0) {
+            unlink_column(column);
+        }
+        e = e->right;
+    } while (e != row);
+}
+
+/* Undo take_row(). */
+DLX_INLINE void
+untake_row(Element *row)
+{
+    Element *e = row->left;
+
+    do {
+        Header *column = e->column;
+        if (e->color) {
+            if (column->purifier == e)
+                unpurify(e);
+        } else if (column->bound < 0 || column->bound++ == 0) {
+            link_column(column);
+        }
+        e = e->left;
+    } while (e != row->left);
+    restore_row(row);
+}
+
+/* Return the column with the fewest ways left to branch on it, and store that
+ * number in *branches.  A column may take any of its rows, or, once it has
+ * been covered enough, nothing more.  Returns NULL if every column is
+ * done. */
+DLX_INLINE Header *
+bounded_column(Header *corner, int *branches)
+{
+    Header *best = NULL;
+    int fewest = 0;
+
+    Header *column = (Header *)corner->e.right;
+    for (; column != corner; column = (Header *)column->e.right) {
+        int n;
+        if (column->count < column->bound - column->slack)
+            n = 0;
+        else
+            n = column->count + (column->bound <= column->slack);
+        if (!best || n < fewest) {
+            best = column;
+            fewest = n;
+        }
+    }
+
+    *branches = fewest;
+    return best;
+}
+
+/* Return the header for the column with the fewest '1's, the first of the
+ * highest priority among equals.  Returns NULL if there are no columns in the
+ * matrix */
+DLX_INLINE Header *
+smallest_column(Header *corner)
+{
+    Header *smallest = NULL;
+
+    Header *column = (Header *)corner->e.right;
+    for (; column != corner; column = (Header *)column->e.right) {
+        if (!smallest || smallest->count > column->count ||
+            (smallest->count == column->count &&
+             smallest->priority > column->priority)) {
+            smallest = column;
+        }
+    }
+
+    return smallest;
+}
+
+/* Return the column of highest priority, the one with the fewest '1's among
+ * equals, or any column with no '1's left.  Returns NULL if there are no
+ * columns in the matrix. */
+DLX_INLINE Header *
+priority_column(Header *corner)
+{
+    Header *best = NULL;
+
+    Header *column = (Header *)corner->e.right;
+    for (; column != corner; column = (Header *)column->e.right) {
+        if (column->count == 0)
+            return column;
+        if (!best || best->priority > column->priority ||
+            (best->priority == column->priority &&
+             best->count > column->count)) {
+            best = column;
+        }
+    }
+
+    return best;
+}
+
+/* Return the number of columns.  Aka, the number of elements in the
+ * universe. */
+DLX_INLINE int
+column_count(Header *corner)
+{
+    int count = 0;
+    Element *e = corner->e.right;
+    for (; e != &corner->e; e = e->right) {
+        count += 1;
+    }
+    return count;
+}
+
+#endif /* DLXLINKS_H */
@@ -19,12 +19,68 @@
  * DEALINGS IN THE SOFTWARE. */
 
 #include "Python.h"
+#include "pythread.h"
+
+#include "dlxlinks.h"
+
+#if PY_MAJOR_VERSION >= 3
+#if PY_VERSION_HEX < 0x030B0000
+#error "exactcover needs Python 2.7, or 3.11 or later"
+#endif
+#define PyInt_FromLong PyLong_FromLong
+#define PyInt_FromSsize_t PyLong_FromSsize_t
+#define PyInt_AsLong PyLong_AsLong
+
+/* Objects of heap types hold a reference to their type. */
+#define VISIT_TYPE(self) Py_VISIT(Py_TYPE((PyObject *)(self)))
+#define RELEASE_TYPE(type) Py_DECREF(type)
+#else
+#define VISIT_TYPE(self)
+#define RELEASE_TYPE(type) (void)(type)
+#define PYTHREAD_INVALID_THREAD_ID (-1)
+
+/* Python 2 cannot tell a failed lookup from a missing key. */
+#define PyDict_GetItemWithError PyDict_GetItem
+#endif
+
+/* Critical sections only exist, and are only needed, without a GIL. */
+#ifndef Py_BEGIN_CRITICAL_SECTION
+#define Py_BEGIN_CRITICAL_SECTION(op) {
+#define Py_END_CRITICAL_SECTION() }
+#endif
+
+/* Define name_locked(), which calls name() inside a critical section on self.
+ * Every entry point which touches an object's search state goes through
+ * one, so on free-threaded builds each object is worked on by one thread at
+ * a time, while different objects run in parallel. */
+#define LOCKED_NOARGS(name, type)                                           \
+    static PyObject *                                                       \
+    name##_locked(type *self)                                               \
+    {                                                                       \
+        PyObject *result;                                                   \
+        Py_BEGIN_CRITICAL_SECTION(self);                                    \
+        result = name(self);                                                \
+        Py_END_CRITICAL_SECTION();                                          \
+        return result;                                                      \
+    }
+
+#define LOCKED_KWARGS(name, type, result_type)                              \
+    static result_type                                                      \
+    name##_locked(type *self, PyObject *args, PyObject *kwds)               \
+    {                                                                       \
+        result_type result;                                                 \
+        Py_BEGIN_CRITICAL_SECTION(self);                                    \
+        result = name(self, args, kwds);                                    \
+        Py_END_CRITICAL_SECTION();                                          \
+        return result;                                                      \
+    }
 
 static char exactcover__doc__[] =
 "Exact cover solver.\n"
 "\n"
 "Solves the exact cover problem using Knuth's DLX, using the shortest\n"
-"column first heuristic.\n"
+"column first heuristic.  Secondary columns, optionally colored, are\n"
+"handled with Knuth's Algorithm C.\n"
 "\n"
 "Given a universe, U, and a collection of subsets of U, S.  Every\n"
 "subcollection of S which is a partition of U is an exact cover.  Finding\n"
@@ -33,224 +89,171 @@ static char exactcover__doc__[] =
 "Many constraint satisfaction problems can be expressed in terms of exact\n"
 "cover, making it useful in a variety of situations.\n";
 
-/* #undef CHECK_INVARIANTS */
-
-typedef struct ElementRec Element;
-typedef struct HeaderRec Header;
-
-/* states */
-enum Action
+/* search engines */
+enum Engine
 {
-    CONTINUE,
-    BACKUP,
-    SOLUTION
+    ENGINE_LINKS,
+    ENGINE_CELLS
 };
 
-/* An element in the sparse matrix. */
-struct ElementRec
+/* column choice heuristics */
+enum Heuristic
 {
-    Element *up;
-    Element *down;
-    Element *left;
-    Element *right;
-
-    Header *column;
-
-    /* A reference to this rows object.  If rows are <= 5 elements it's a win
-     * to keep a pointer in every element.  It also reduces complexity. */
-    PyObject *object;
+    HEURISTIC_SMALLEST,
+    HEURISTIC_WEIGHTED,
+    HEURISTIC_PRIORITY
 };
 
-/* A header for a column in the sparse matrix.  Keeps track of a count of
- * rows which have a '1' in this column. */
-struct HeaderRec
+/* restart policies */
+enum Restart
 {
-    Element e;
-
-    int count;
-    PyObject *object;
+    RESTART_NONE,
+    RESTART_LUBY,
+    RESTART_GEOMETRIC
 };
 
-/* ------------------------------------------------------------------------ *
- * Sparse Matrix Representation                                             *
- * ------------------------------------------------------------------------ */
-
-#if defined(CHECK_INVARIANTS) && !defined(NDEBUG)
-static void
-check_row(Element *row)
-{
-    Element *e = row;
-    do {
-        assert(e->right->left == e);
-        assert(e->left->right == e);
-        e = e->right;
-    } while (e != row);
-}
-
-static void
-check_column(Header *column)
+/* treatments of identical rows */
+enum Duplicates
 {
-    int count = 0;
-    Element *e = &column->e;
-    do {
-        assert(e->up->down = e);
-        assert(e->down->up = e);
-        assert(e->column = column);
-        check_row(e);
-        e = e->down;
-        count++;
-    } while (e != &column->e);
-    assert(column->count == count - 1);
-}
+    DUPLICATES_KEEP,
+    DUPLICATES_EXPAND,
+    DUPLICATES_COUNT
+};
 
-static void
-check(Header *corner)
+/* states */
+enum Action
 {
-    Element *e;
-
-    assert(corner->e.up == &corner->e);
-    assert(corner->e.down == &corner->e);
-
-    for (e = corner->e.right; e != &corner->e; e = e->right)
-    {
-        check_column((Header*)e);
-    }
-}
-#define CHECK(x) check(x)
-#else
-#define CHECK(x)
-#endif
+    CONTINUE,
+    BACKUP,
+    SOLUTION
+};
 
-/* Remove a column and all rows with a '1' in that column from the matrix. */
-static void
-unlink_column(Header *column)
+/* outcomes of a search */
+enum Search
 {
-    Element *row;
-    Element *e;
-
-    /* remove Header element */
-    column->e.left->right = column->e.right;
-    column->e.right->left = column->e.left;
+    SEARCH_FOUND,
+    SEARCH_DONE,
+    SEARCH_CANCELLED
+};
 
-    /* remove rows */
-    for (row = column->e.up; row != &column->e; row = row->up) {
-        for (e = row->left; e != row; e = e->left) {
-            e->column->count--;
-            e->up->down = e->down;
-            e->down->up = e->up;
-        }
-    }
-}
+/* ------------------------------------------------------------------------ *
+ * Matrix Construction                                                      *
+ * ------------------------------------------------------------------------ */
 
-/* Remove a row from the matrix. */
-static void
-unlink_row(Element *row)
-{
-    Element *e = row;
-    do {
-        unlink_column(e->column);
-        e = e->right;
-    } while (e != row);
-}
+/* The columns, by their objects.  Objects which cannot be hashed are not in
+ * dict, and are found by scanning the header chains instead. */
+typedef struct {
+    PyObject *dict;     /* Object to the address of its header. */
+    int unhashable;     /* Columns whose objects are not in dict. */
+} ColumnIndex;
 
-/* Put a column back into the matrix.  Must be called in the exact reverse
- * order of unlink_column(). */
-static void
-link_column(Header *column)
+/* Linear scan of one header chain for object.  Returns 1 and sets *found if
+ * it is there, 0 if not, -1 on failure. */
+static int
+scan_column(Header *corner, PyObject *object, Header **found)
 {
-    Element *row;
-    Element *e;
-
-    /* link Header element */
-    column->e.left->right = &column->e;
-    column->e.right->left = &column->e;
+    Header *i;
 
-    /* Add rows */
-    for (row = column->e.down; row != &column->e; row = row->down) {
-        for (e = row->right; e != row; e = e->right) {
-            e->column->count++;
-            e->up->down = e;
-            e->down->up = e;
+    for (i = (Header *)corner->e.right; i != corner;
+         i = (Header *)i->e.right) {
+        int cmp = PyObject_RichCompareBool(i->object, object, Py_EQ);
+        if (cmp == -1) {
+            return -1;
+        } else if (cmp == 1) {
+            *found = i;
+            return 1;
         }
     }
+    return 0;
 }
 
-/* Put a row back into the matrix.  Must be called in the exact reverse order
- * of link_row(). */
-static void
-link_row(Element *row)
-{
-    Element *e = row->left;
-    do {
-        link_column(e->column);
-        e = e->left;
-    } while (e != row->left);
-}
-
-/* Return the header for the column with the fewest '1's.  Returns NULL if
- * there are no columns in the matrix */
-static Header *
-smallest_column(Header *corner)
+/* Look up the column of object, in either chain.  Returns 1 and sets *found
+ * if it is there, 0 if not, -1 on failure.  Secondary columns are the ones
+ * with a negative bound. */
+static int
+lookup_column(ColumnIndex *index, Header *corner, Header *secondary,
+              PyObject *object, Header **found)
 {
-    Header *smallest = NULL;
+    int result;
 
-    Header *column = (Header *)corner->e.right;
-    for (; column != corner; column = (Header *)column->e.right) {
-        if (!smallest || smallest->count > column->count) {
-            smallest = column;
+    if (PyObject_Hash(object) == -1) {
+        if (!PyErr_ExceptionMatches(PyExc_TypeError))
+            return -1;
+        PyErr_Clear();
+    } else {
+        PyObject *address = PyDict_GetItemWithError(index->dict, object);
+        if (address) {
+            *found = (Header *)PyLong_AsVoidPtr(address);
+            return 1;
         }
+        if (PyErr_Occurred())
+            return -1;
+        if (!index->unhashable)
+            return 0;
     }
 
-    return smallest;
-}
-
-/* Return the number of columns.  Aka, the number of elements in the
- * universe. */
-static int
-column_count(Header *corner)
-{
-    int count = 0;
-    Element *e = corner->e.right;
-    for (; e != &corner->e; e = e->right) {
-        count += 1;
-    }
-    return count;
+    result = scan_column(secondary, object, found);
+    if (result == 0)
+        result = scan_column(corner, object, found);
+    return result;
 }
 
-/* Finds or inserts a column, returns NULL on failure. */
+/* Finds or inserts a column, returns NULL on failure.  A new column is
+ * secondary if isSecondary is set, and has no index yet. */
 static Header *
-find_column(Header *corner, PyObject *object)
+find_column(ColumnIndex *index, Header *corner, Header *secondary,
+            PyObject *object, int isSecondary)
 {
+    Header *chain = isSecondary ? secondary : corner;
     Header *i;
+    int found;
 
-    /* Linear scan of the universe for this object */
-    for (i = (Header *)corner->e.right; i != corner;
-         i = (Header *)i->e.right) {
-        int cmp = PyObject_RichCompareBool(i->object, object, Py_EQ);
-        if (cmp == -1) {
-            return NULL;
-        } else if (cmp == 1) {
-            return i;
-        }
-    }
+    found = lookup_column(index, corner, secondary, object, &i);
+    if (found == -1)
+        return NULL;
+    else if (found == 1)
+        return i;
 
     /* New header element. */
     i = PyMem_New(Header, 1);
-    if (!i)
+    if (!i) {
+        PyErr_NoMemory();
         return NULL;
+    }
     i->e.up = &i->e;
     i->e.down = &i->e;
     i->e.column = i;
+    i->e.row = -1;
+    i->e.color = 0;
     i->e.object = NULL;
+    i->count = 0;
+    i->index = -1;
+    i->purifier = NULL;
+    i->bound = isSecondary ? -1 : 1;
+    i->slack = 0;
+    i->weight = 1;
+    i->priority = 0;
+
+    if (PyObject_Hash(object) == -1) {
+        PyErr_Clear();
+        index->unhashable++;
+    } else {
+        PyObject *address = PyLong_FromVoidPtr(i);
+        if (!address || PyDict_SetItem(index->dict, object, address) < 0) {
+            Py_XDECREF(address);
+            PyMem_Del(i);
+            return NULL;
+        }
+        Py_DECREF(address);
+    }
     Py_INCREF(object);
     i->object = object;
-    i->count = 0;
 
     /* Link into the header chain. */
-    i->e.right = &corner->e;
-    i->e.left = corner->e.left;
-    corner->e.left->right = &i->e;
-    corner->e.left = &i->e;
+    i->e.right = &chain->e;
+    i->e.left = chain->e.left;
+    chain->e.left->right = &i->e;
+    chain->e.left = &i->e;
 
     return i;
 }
@@ -269,21 +272,52 @@ alloc_matrix(void)
     corner->e.left = &corner->e;
     corner->e.right = &corner->e;
     corner->e.column = corner;
+    corner->e.row = -1;
+    corner->e.color = 0;
     corner->e.object = NULL;
     corner->count = 0;
     corner->object = NULL;
+    corner->index = -1;
+    corner->purifier = NULL;
+    corner->bound = 0;
+    corner->slack = 0;
+    corner->weight = 1;
+    corner->priority = 0;
 
     return corner;
 }
 
-/* Free a matrix */
+/* Free the elements of count rows, or if they are packed into a block
+ * which their owner frees, only release their objects.  Rows are freed along
+ * their horizontal links, which are never unlinked, so it does not matter
+ * which of them are still in their columns. */
 static void
-free_matrix(Header *corner)
+free_rows(Element **rows, int count, int packed)
 {
-    Header *column;
-    Header *next_column;
     Element *e;
     Element *next_e;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (!rows[i])
+            continue;
+        rows[i]->left->right = NULL;
+        for (e = rows[i]; e; e = next_e) {
+            next_e = e->right;
+            Py_DECREF(e->object);
+            if (!packed)
+                PyMem_Del(e);
+        }
+    }
+}
+
+/* Free a matrix's column headers, unless they are packed into a block which
+ * their owner frees.  The elements are freed by free_rows(). */
+static void
+free_matrix(Header *corner, int packed)
+{
+    Header *column;
+    Header *next_column;
 
     /* Safe to delete NULL */
     if (corner == NULL)
@@ -292,18 +326,12 @@ free_matrix(Header *corner)
     for (column = (Header *)corner->e.right;
          column != corner;
          column = next_column) {
-        /* Free the elements of this column */
-        for (e = column->e.down; e != &column->e; e = next_e) {
-            next_e = e->down;
-            Py_DECREF(e->object);
-            PyMem_Del(e);
-        }
-
         assert(column->e.object == NULL);
 
         next_column = (Header *)column->e.right;
         Py_DECREF(column->object);
-        PyMem_Del(column);
+        if (!packed)
+            PyMem_Del(column);
     }
 
     PyMem_Del(corner);
@@ -311,175 +339,5509 @@ free_matrix(Header *corner)
 
 
 /* ------------------------------------------------------------------------ *
- * Coverings class                                                          *
+ * Dancing Cells                                                            *
  * ------------------------------------------------------------------------ */
-typedef struct {
-    PyObject_HEAD
 
-    /* Sparse matrix representing the problem. */
-    Header *corner;
+/* An alternative representation of the same search, after Knuth's dancing
+ * cells.  The nodes of each row are contiguous, and every column keeps its
+ * rows as a sparse set: an array of nodes whose first size entries are the
+ * rows still present.  Hiding a row swaps its nodes past the ends of their
+ * columns' sets, and is undone just by growing the sets again, so there is
+ * no pointer chasing and nothing to relink.
+ *
+ * A column stops being maintained once it is covered or purified, so its set
+ * is frozen until it is restored.
+ *
+ * What never changes during a search, the nodes of each row, the place of
+ * each column's set and the starting state, is kept in a CellsLayout, which
+ * any number of searches may share; each search has its own Cells, holding
+ * only the sets and the stack.  The arrays of a layout are one block of
+ * ints, holding only indices, so it may be copied to shared memory and
+ * used by other processes where it lies. */
+typedef struct CellsLayoutRec CellsLayout;
+typedef struct CellsRec Cells;
 
-    /* Non-zero if next() has never been called. */
-    int first;
+struct CellsLayoutRec
+{
+    /* The block, which starts with LAYOUT_HEADER words giving the magic
+     * number and the counts below.  It was either allocated, or belongs to
+     * view. */
+    int *block;
+    Py_ssize_t words;
+    Py_buffer view;
 
-    /* A stack representing the current solution.  This has at most
-     * len(universe) elements. */
-    Element **solution;
-    int solutionSize;
-} Coverings;
+    /* Nodes.  Row r owns nodes start[r] .. start[r + 1] - 1. */
+    int nodeCount;
+    int *item;
+    int *color;
+    int *owner;     /* Row of each node. */
 
-static char Coverings__doc__[] =
-"Coverings(iterable) -> Coverings object\n"
-"\n"
-"Compute exact covers.\n"
-"\n"
-"Return an Coverings object whose .next() method returns a tuple of\n"
-"elements from iterable which cover the union of all the elements of\n"
-"iterable.  iterable must yield sequences.\n"
-"\n"
-"While the elements may be mutable, mutating them will have no effect on\n"
-"the results produced.  It is recommended that they remain unchanged\n"
-"during the iteration.\n";
+    int rowCount;
+    int *start;
+    int *index;     /* Input index of each row. */
+    PyObject **objects; /* The row itself, owned, or NULL for the index. */
 
-/* Make one solving step, returns an Action.
- *
- * CONTINUE = Some of the universe is uncovered, call this function again.
- * BACKUP = The remaining universe cannot be covered, backtrack then call this
- *          function again.
- * SOLUTION = solution contains a covering set. */
+    /* The row laid out for each input index, or -1. */
+    int inputCount;
+    int *row;
+
+    /* Columns, and the state a search starts from. */
+    int itemCount;
+    int *first;
+    int *set;
+    int *pos;
+    int *size;
+    int *live;
+    int *active;
+    int activeCount;
+};
+
+struct CellsRec
+{
+    /* Shared with the layout. */
+    const CellsLayout *layout;
+    int nodeCount;
+    const int *item;
+    const int *color;
+    const int *owner;
+    const int *start;
+
+    int *pos;       /* Position of each node in its column's set. */
+
+    /* Columns.  The set of column i is set[first[i]] ..
+     * set[first[i] + size[i] - 1]. */
+    int itemCount;
+    const int *first;
+    int *set;
+    int *size;
+    int *live;      /* Non-zero while a column is maintained. */
+    int *purifier;  /* Node whose color a secondary column was purified to. */
+
+    /* The primary columns which are still to be covered, also a sparse
+     * set. */
+    int *active;
+    int *activePos;
+    int activeCount;
+
+    /* Search stack: the column branched on at each level, and the position
+     * in its set of the row being tried.  Levels below base are a prefix,
+     * which is never backed out of. */
+    int *levelItem;
+    int *levelPos;
+    int depth;
+    int base;
+};
+
+/* Remove every node of row r from the columns which are still
+ * maintained. */
+static void
+cells_hide(Cells *cells, int r)
+{
+    int n;
+
+    for (n = cells->start[r]; n < cells->start[r + 1]; n++) {
+        int i = cells->item[n];
+        int *set;
+        int last;
+
+        if (!cells->live[i])
+            continue;
+        set = cells->set + cells->first[i];
+        last = set[--cells->size[i]];
+        set[cells->pos[n]] = last;
+        cells->pos[last] = cells->pos[n];
+        set[cells->size[i]] = n;
+        cells->pos[n] = cells->size[i];
+    }
+}
+
+/* Undo cells_hide().  The node is still just past the end of its set. */
+static void
+cells_unhide(Cells *cells, int r)
+{
+    int n;
+
+    for (n = cells->start[r + 1] - 1; n >= cells->start[r]; n--) {
+        if (cells->live[cells->item[n]])
+            cells->size[cells->item[n]]++;
+    }
+}
+
+/* Stop maintaining column i, and hide every row in it whose node has a color
+ * other than color.  A color of 0 hides every row, covering the column. */
+static void
+cells_cover(Cells *cells, int i, int color)
+{
+    int *set = cells->set + cells->first[i];
+    int k;
+
+    cells->live[i] = 0;
+    if (cells->activePos[i] >= 0) {
+        int last = cells->active[--cells->activeCount];
+        cells->active[cells->activePos[i]] = last;
+        cells->activePos[last] = cells->activePos[i];
+        cells->active[cells->activeCount] = i;
+        cells->activePos[i] = cells->activeCount;
+    }
+    for (k = 0; k < cells->size[i]; k++) {
+        if (!color || cells->color[set[k]] != color)
+            cells_hide(cells, cells->owner[set[k]]);
+    }
+}
+
+/* Undo cells_cover(). */
+static void
+cells_uncover(Cells *cells, int i, int color)
+{
+    int *set = cells->set + cells->first[i];
+    int k;
+
+    for (k = cells->size[i] - 1; k >= 0; k--) {
+        if (!color || cells->color[set[k]] != color)
+            cells_unhide(cells, cells->owner[set[k]]);
+    }
+    if (cells->activePos[i] >= 0)
+        cells->activeCount++;
+    cells->live[i] = 1;
+}
+
+/* Cover or purify the columns of row r, other than the one branched on. */
+static void
+cells_commit(Cells *cells, int r)
+{
+    int n;
+
+    for (n = cells->start[r]; n < cells->start[r + 1]; n++) {
+        int i = cells->item[n];
+        if (!cells->live[i])
+            continue;
+        if (cells->color[n])
+            cells->purifier[i] = n;
+        cells_cover(cells, i, cells->color[n]);
+    }
+}
+
+/* Undo cells_commit(). */
+static void
+cells_uncommit(Cells *cells, int r)
+{
+    int n;
+
+    for (n = cells->start[r + 1] - 1; n >= cells->start[r]; n--) {
+        int i = cells->item[n];
+        if (cells->live[i])
+            continue;
+        if (!cells->color[n] && cells->levelItem[cells->depth - 1] != i) {
+            cells_uncover(cells, i, 0);
+        } else if (cells->color[n] && cells->purifier[i] == n) {
+            cells->purifier[i] = -1;
+            cells_uncover(cells, i, cells->color[n]);
+        }
+    }
+}
+
+/* The row being tried at the top level. */
+#define CELLS_ROW(cells) \
+    ((cells)->owner[(cells)->set[ \
+        (cells)->first[(cells)->levelItem[(cells)->depth - 1]] + \
+        (cells)->levelPos[(cells)->depth - 1]]])
+
+/* Coverings_step() for dancing cells. */
 static int
-Coverings_step(Coverings *self)
+cells_step(Cells *cells)
 {
-    Header *column = NULL;
-    Element *row = NULL;
+    int best = -1;
+    int k;
 
-    /* New column. */
-    column = smallest_column(self->corner);
-    if (column == NULL ) {
+    if (cells->activeCount == 0)
         return SOLUTION;
-    } else if (column->count == 0) {
-        return BACKUP;
+    for (k = 0; k < cells->activeCount; k++) {
+        int i = cells->active[k];
+        if (best < 0 || cells->size[i] < cells->size[best])
+            best = i;
     }
-    row = column->e.down;
-
-    /* Add new row. */
-    unlink_row(row);
-    CHECK(self->corner);
-    self->solution[self->solutionSize] = row;
-    self->solutionSize++;
+    if (cells->size[best] == 0)
+        return BACKUP;
 
+    cells_cover(cells, best, 0);
+    cells->levelItem[cells->depth] = best;
+    cells->levelPos[cells->depth] = 0;
+    cells->depth++;
+    cells_commit(cells, CELLS_ROW(cells));
     return CONTINUE;
 }
 
-/* backtrack.  Returns -1 if there are no more solutions */
+/* Coverings_backup() for dancing cells. */
 static int
-Coverings_backup(Coverings *self)
+cells_backup(Cells *cells)
 {
-    while (self->solutionSize > 0) {
-        Element *row = self->solution[self->solutionSize - 1];
-        link_row(row);
-        CHECK(self->corner);
-        row = row->down;
-        if (row == &row->column->e) {
-            self->solutionSize--;
-        } else {
-            unlink_row(row);
-            CHECK(self->corner);
-            self->solution[self->solutionSize - 1] = row;
+    while (cells->depth > cells->base) {
+        int i = cells->levelItem[cells->depth - 1];
+
+        cells_uncommit(cells, CELLS_ROW(cells));
+        if (++cells->levelPos[cells->depth - 1] < cells->size[i]) {
+            cells_commit(cells, CELLS_ROW(cells));
+            return 0;
+        }
+        cells_uncover(cells, i, 0);
+        cells->depth--;
+    }
+    return -1;
+}
+
+#define LAYOUT_NAME "exactcover.CellsLayout"
+#define LAYOUT_MAGIC 0x4c584345L /* "ECXL" */
+#define LAYOUT_HEADER 6
+
+/* Free a layout, safe on partially built ones. */
+static void
+free_layout(CellsLayout *layout)
+{
+    int r;
+
+    if (!layout)
+        return;
+    for (r = 0; layout->objects && r < layout->rowCount; r++)
+        Py_XDECREF(layout->objects[r]);
+    PyMem_Del(layout->objects);
+    if (layout->view.obj)
+        PyBuffer_Release(&layout->view);
+    else
+        PyMem_Del(layout->block);
+    PyMem_Del(layout);
+}
+
+static void
+layout_destructor(PyObject *capsule)
+{
+    free_layout((CellsLayout *)PyCapsule_GetPointer(capsule, LAYOUT_NAME));
+}
+
+/* Point the arrays of layout into its block, whose header gives the counts.
+ * Returns -1 if the block is too small for them. */
+static int
+layout_place(CellsLayout *layout)
+{
+    int *p = layout->block;
+    Py_ssize_t words;
+
+    if (layout->words < LAYOUT_HEADER)
+        return -1;
+    layout->nodeCount = p[1];
+    layout->rowCount = p[2];
+    layout->inputCount = p[3];
+    layout->itemCount = p[4];
+    layout->activeCount = p[5];
+    if (layout->nodeCount < 0 || layout->rowCount < 0 ||
+        layout->inputCount < layout->rowCount || layout->itemCount < 0 ||
+        layout->activeCount < 0 || layout->activeCount > layout->itemCount)
+        return -1;
+
+    words = LAYOUT_HEADER + 5 * (Py_ssize_t)layout->nodeCount +
+            2 * (Py_ssize_t)layout->rowCount + 1 + layout->inputCount +
+            4 * (Py_ssize_t)layout->itemCount;
+    if (layout->words < words)
+        return -1;
+
+    p += LAYOUT_HEADER;
+    layout->item = p;
+    p += layout->nodeCount;
+    layout->color = p;
+    p += layout->nodeCount;
+    layout->owner = p;
+    p += layout->nodeCount;
+    layout->set = p;
+    p += layout->nodeCount;
+    layout->pos = p;
+    p += layout->nodeCount;
+    layout->start = p;
+    p += layout->rowCount + 1;
+    layout->index = p;
+    p += layout->rowCount;
+    layout->row = p;
+    p += layout->inputCount;
+    layout->first = p;
+    p += layout->itemCount;
+    layout->size = p;
+    p += layout->itemCount;
+    layout->live = p;
+    p += layout->itemCount;
+    layout->active = p;
+    return 0;
+}
+
+/* Check that a layout from elsewhere is one alloc_layout() could have made,
+ * so searching it cannot stray outside the block: every index is in range,
+ * the column sets are laid end to end in column order, each as long as the
+ * nodes of its column, every node is in its own set, and the active columns
+ * are distinct and live.  Nodes of active columns have no color, and those
+ * of columns which are not live have one, as backing up uncovers a column
+ * which is not live for each node without a color.  Returns -1 with an
+ * exception set if not. */
+static int
+layout_check(CellsLayout *layout)
+{
+    int *count = NULL;
+    int *active;
+    int nodes, items;
+    int n, r, i;
+
+    if (layout->words < LAYOUT_HEADER || layout->block[0] != LAYOUT_MAGIC ||
+        layout_place(layout) < 0)
+        goto invalid;
+    nodes = layout->nodeCount;
+    items = layout->itemCount;
+    if (layout->start[0] != 0 || layout->start[layout->rowCount] != nodes)
+        goto invalid;
+    for (r = 0; r < layout->rowCount; r++) {
+        if (layout->start[r] > layout->start[r + 1] ||
+            layout->index[r] < 0 || layout->index[r] >= layout->inputCount ||
+            layout->row[layout->index[r]] != r)
+            goto invalid;
+    }
+    for (r = 0; r < layout->inputCount; r++) {
+        if (layout->row[r] < -1 || layout->row[r] >= layout->rowCount)
+            goto invalid;
+    }
+
+    /* The sets, end to end, fill the nodes exactly. */
+    n = 0;
+    for (i = 0; i < items; i++) {
+        if (layout->first[i] != n || layout->size[i] < 0 ||
+            layout->size[i] > nodes - n ||
+            (layout->live[i] != 0 && layout->live[i] != 1))
+            goto invalid;
+        n += layout->size[i];
+    }
+    if (n != nodes)
+        goto invalid;
+
+    count = PyMem_New(int, 2 * (items + 1));
+    if (!count) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    active = count + items + 1;
+    memset(count, 0, 2 * (items + 1) * sizeof(int));
+    for (i = 0; i < items; i++) {
+        int k = layout->active[i];
+        if (k < 0 || k >= items)
+            goto invalid;
+        if (i < layout->activeCount && (!layout->live[k] || active[k]++))
+            goto invalid;
+    }
+    for (n = 0; n < nodes; n++) {
+        i = layout->item[n];
+        r = layout->owner[n];
+        if (i < 0 || i >= items || r < 0 || r >= layout->rowCount ||
+            n < layout->start[r] || n >= layout->start[r + 1] ||
+            layout->pos[n] < 0 || layout->pos[n] >= layout->size[i] ||
+            layout->set[layout->first[i] + layout->pos[n]] != n ||
+            (active[i] ? layout->color[n] != 0
+                       : !layout->live[i] && layout->color[n] == 0))
+            goto invalid;
+        count[i]++;
+    }
+    for (i = 0; i < items; i++) {
+        if (count[i] != layout->size[i])
+            goto invalid;
+    }
+    PyMem_Del(count);
+    return 0;
+
+invalid:
+    PyMem_Del(count);
+    PyErr_SetString(PyExc_ValueError, "not a layout");
+    return -1;
+}
+
+/* Wrap a layout in a capsule owning it, or free it on failure. */
+static PyObject *
+layout_capsule(CellsLayout *layout)
+{
+    PyObject *capsule = PyCapsule_New(layout, LAYOUT_NAME, layout_destructor);
+    if (!capsule)
+        free_layout(layout);
+    return capsule;
+}
+
+/* Lay out dancing cells for the part of a matrix which is still linked, as
+ * a capsule owning the layout.  Columns are numbered by Header.index;
+ * covered and purified columns are simply never live.  Rows are laid out in
+ * the order given by order, or by index if it is NULL.  Returns NULL with an
+ * exception set on failure. */
+static PyObject *
+alloc_layout(Header *corner, Header *secondary, Element **rows, int rowCount,
+             int itemCount, int *order)
+{
+    CellsLayout *layout;
+    Header *column;
+    int nodeCount = 0;
+    int count = 0;
+    int activeCount = 0;
+    int k, r;
+    int i;
+    int n;
+
+    layout = PyMem_New(CellsLayout, 1);
+    if (!layout)
+        return PyErr_NoMemory();
+    memset(layout, 0, sizeof(CellsLayout));
+
+    /* Count the rows and nodes still present. */
+    for (r = 0; r < rowCount; r++) {
+        Element *e = rows[r];
+        if (!e || !row_available(e))
+            continue;
+        count++;
+        do {
+            nodeCount++;
+            e = e->right;
+        } while (e != rows[r]);
+    }
+    for (column = (Header *)corner->e.right; column != corner;
+         column = (Header *)column->e.right)
+        activeCount++;
+
+    layout->words = LAYOUT_HEADER + 5 * (Py_ssize_t)nodeCount +
+                    2 * (Py_ssize_t)count + 1 + rowCount +
+                    4 * (Py_ssize_t)itemCount;
+    layout->block = PyMem_New(int, layout->words);
+    layout->objects = PyMem_New(PyObject *, count + 1);
+    if (!layout->block || !layout->objects) {
+        free_layout(layout);
+        return PyErr_NoMemory();
+    }
+    layout->block[0] = LAYOUT_MAGIC;
+    layout->block[1] = nodeCount;
+    layout->block[2] = count;
+    layout->block[3] = rowCount;
+    layout->block[4] = itemCount;
+    layout->block[5] = activeCount;
+    layout_place(layout);
+
+    for (i = 0; i < itemCount; i++) {
+        layout->size[i] = 0;
+        layout->live[i] = 0;
+        layout->active[i] = 0;
+    }
+    k = 0;
+    for (column = (Header *)corner->e.right; column != corner;
+         column = (Header *)column->e.right) {
+        layout->live[column->index] = 1;
+        layout->active[k++] = column->index;
+    }
+    for (column = (Header *)secondary->e.right; column != secondary;
+         column = (Header *)column->e.right) {
+        if (!column->purifier)
+            layout->live[column->index] = 1;
+    }
+
+    /* Lay out the rows, counting the nodes of each column. */
+    n = 0;
+    count = 0;
+    for (r = 0; r < rowCount; r++)
+        layout->row[r] = -1;
+    for (k = 0; k < rowCount; k++) {
+        Element *e;
+        r = order ? order[k] : k;
+        e = rows[r];
+        if (!e || !row_available(e))
+            continue;
+        layout->start[count] = n;
+        layout->index[count] = r;
+        layout->row[r] = count;
+        Py_INCREF(e->object);
+        layout->objects[count] = e->object;
+        do {
+            layout->item[n] = e->column->index;
+            layout->color[n] = e->color;
+            layout->owner[n] = count;
+            layout->size[e->column->index]++;
+            n++;
+            e = e->right;
+        } while (e != rows[r]);
+        count++;
+    }
+    layout->start[count] = n;
+
+    /* Lay out the column sets. */
+    n = 0;
+    for (i = 0; i < itemCount; i++) {
+        layout->first[i] = n;
+        n += layout->size[i];
+        layout->size[i] = 0;
+    }
+    for (n = 0; n < layout->nodeCount; n++) {
+        i = layout->item[n];
+        layout->pos[n] = layout->size[i];
+        layout->set[layout->first[i] + layout->size[i]++] = n;
+    }
+
+    return layout_capsule(layout);
+}
+
+/* PyObject_GetBuffer(), which on Python 2 also takes objects with only the
+ * old buffer interface, such as mmaps. */
+static int
+get_read_buffer(PyObject *obj, Py_buffer *view)
+{
+#if PY_MAJOR_VERSION < 3
+    if (!PyObject_CheckBuffer(obj)) {
+        const void *buf;
+        Py_ssize_t len;
+        if (PyObject_AsReadBuffer(obj, &buf, &len) < 0)
+            return -1;
+        return PyBuffer_FillInfo(view, obj, (void *)buf, len, 1,
+                                 PyBUF_SIMPLE);
+    }
+#endif
+    return PyObject_GetBuffer(obj, view, PyBUF_SIMPLE);
+}
+
+/* Use a layout written by share() where it lies in buffer.  rows, unless it
+ * is None, is the sequence of rows it was made from; otherwise coverings
+ * give the index of each row.  Returns a capsule owning the layout, or NULL
+ * with an exception set. */
+static PyObject *
+attach_layout(PyObject *buffer, PyObject *rows)
+{
+    CellsLayout *layout;
+    int r;
+
+    layout = PyMem_New(CellsLayout, 1);
+    if (!layout)
+        return PyErr_NoMemory();
+    memset(layout, 0, sizeof(CellsLayout));
+    if (get_read_buffer(buffer, &layout->view) < 0) {
+        PyMem_Del(layout);
+        return NULL;
+    }
+    layout->block = (int *)layout->view.buf;
+    layout->words = layout->view.len / (Py_ssize_t)sizeof(int);
+    if (((size_t)layout->block % sizeof(int)) != 0) {
+        free_layout(layout);
+        PyErr_SetString(PyExc_ValueError, "not a layout");
+        return NULL;
+    }
+    if (layout_check(layout) < 0) {
+        free_layout(layout);
+        return NULL;
+    }
+
+    if (rows != Py_None) {
+        PyObject *fast = PySequence_Fast(rows, "rows must be a sequence");
+        if (!fast) {
+            free_layout(layout);
+            return NULL;
+        }
+        if (PySequence_Fast_GET_SIZE(fast) != layout->inputCount) {
+            Py_DECREF(fast);
+            free_layout(layout);
+            PyErr_SetString(PyExc_ValueError, "layout does not match rows");
+            return NULL;
+        }
+        layout->objects = PyMem_New(PyObject *, layout->rowCount + 1);
+        if (!layout->objects) {
+            Py_DECREF(fast);
+            free_layout(layout);
+            return PyErr_NoMemory();
+        }
+        for (r = 0; r < layout->rowCount; r++) {
+            PyObject *object =
+                PySequence_Fast_GET_ITEM(fast, layout->index[r]);
+            Py_INCREF(object);
+            layout->objects[r] = object;
+        }
+        Py_DECREF(fast);
+    }
+    return layout_capsule(layout);
+}
+
+/* Free cells, safe on partially built ones. */
+static void
+free_cells(Cells *cells)
+{
+    if (!cells)
+        return;
+    PyMem_Del(cells->pos);
+    PyMem_Del(cells->set);
+    PyMem_Del(cells->size);
+    PyMem_Del(cells->live);
+    PyMem_Del(cells->purifier);
+    PyMem_Del(cells->active);
+    PyMem_Del(cells->activePos);
+    PyMem_Del(cells->levelItem);
+    PyMem_Del(cells->levelPos);
+    PyMem_Del(cells);
+}
+
+/* Start a search over the layout owned by capsule, which must outlive it.
+ * Returns NULL with an exception set on failure. */
+static Cells *
+alloc_cells(PyObject *capsule)
+{
+    const CellsLayout *layout;
+    Cells *cells;
+    int i, k;
+
+    layout = (CellsLayout *)PyCapsule_GetPointer(capsule, LAYOUT_NAME);
+    if (!layout)
+        return NULL;
+    cells = PyMem_New(Cells, 1);
+    if (!cells)
+        return (Cells *)PyErr_NoMemory();
+    memset(cells, 0, sizeof(Cells));
+
+    cells->layout = layout;
+    cells->nodeCount = layout->nodeCount;
+    cells->item = layout->item;
+    cells->color = layout->color;
+    cells->owner = layout->owner;
+    cells->start = layout->start;
+    cells->itemCount = layout->itemCount;
+    cells->first = layout->first;
+
+    i = layout->itemCount + 1;
+    k = layout->nodeCount + 1;
+    cells->pos = PyMem_New(int, k);
+    cells->set = PyMem_New(int, k);
+    cells->size = PyMem_New(int, i);
+    cells->live = PyMem_New(int, i);
+    cells->purifier = PyMem_New(int, i);
+    cells->active = PyMem_New(int, i);
+    cells->activePos = PyMem_New(int, i);
+    cells->levelItem = PyMem_New(int, i);
+    cells->levelPos = PyMem_New(int, i);
+    if (!cells->pos || !cells->set || !cells->size || !cells->live ||
+        !cells->purifier || !cells->active || !cells->activePos ||
+        !cells->levelItem || !cells->levelPos) {
+        free_cells(cells);
+        return (Cells *)PyErr_NoMemory();
+    }
+
+    /* The arrays are allocated one longer than needed, so that none is
+     * empty, but the layout's are exactly as long as the counts. */
+    memcpy(cells->pos, layout->pos, layout->nodeCount * sizeof(int));
+    memcpy(cells->set, layout->set, layout->nodeCount * sizeof(int));
+    memcpy(cells->size, layout->size, layout->itemCount * sizeof(int));
+    memcpy(cells->live, layout->live, layout->itemCount * sizeof(int));
+    memcpy(cells->active, layout->active, layout->itemCount * sizeof(int));
+    for (i = 0; i < layout->itemCount; i++) {
+        cells->purifier[i] = -1;
+        cells->activePos[i] = -1;
+    }
+    for (k = 0; k < layout->activeCount; k++)
+        cells->activePos[cells->active[k]] = k;
+    cells->activeCount = layout->activeCount;
+    return cells;
+}
+
+/* Push row r on the stack as though the search had chosen it for one of its
+ * primary columns, and make it part of the prefix.  Returns 0 if the row is
+ * not currently available. */
+static int
+cells_choose(Cells *cells, int r)
+{
+    int n;
+
+    for (n = cells->start[r]; n < cells->start[r + 1]; n++) {
+        int i = cells->item[n];
+        if (cells->activePos[i] < 0)
+            continue;
+        if (cells->activePos[i] >= cells->activeCount ||
+            cells->pos[n] >= cells->size[i])
             return 0;
+
+        cells_cover(cells, i, 0);
+        cells->levelItem[cells->depth] = i;
+        cells->levelPos[cells->depth] = cells->pos[n];
+        cells->depth++;
+        cells_commit(cells, r);
+        cells->base = cells->depth;
+        return 1;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ *
+ * Randomization                                                            *
+ * ------------------------------------------------------------------------ */
+
+/* Nodes searched in the first run when restarting. */
+#define RESTART_UNIT 128
+
+/* Advance a 32 bit xorshift generator.  The state must not be zero. */
+static unsigned long
+next_random(unsigned long *state)
+{
+    unsigned long x = *state;
+    x ^= (x << 13) & 0xffffffffUL;
+    x ^= x >> 17;
+    x ^= (x << 5) & 0xffffffffUL;
+    *state = x;
+    return x;
+}
+
+/* Like smallest_column(), but ties are broken at random. */
+static Header *
+random_smallest_column(Header *corner, unsigned long *state)
+{
+    Header *smallest = NULL;
+    unsigned long ties = 0;
+
+    Header *column = (Header *)corner->e.right;
+    for (; column != corner; column = (Header *)column->e.right) {
+        if (!smallest || smallest->count > column->count ||
+            (smallest->count == column->count &&
+             smallest->priority > column->priority)) {
+            smallest = column;
+            ties = 1;
+        } else if (smallest->count == column->count &&
+                   smallest->priority == column->priority &&
+                   next_random(state) % ++ties == 0) {
+            smallest = column;
+        }
+    }
+
+    return smallest;
+}
+
+/* Return the column with the fewest rows for its weight, or NULL if there are
+ * no columns.  Ties are broken by priority, then at random if state is not
+ * NULL. */
+static Header *
+weighted_column(Header *corner, unsigned long *state)
+{
+    Header *best = NULL;
+    unsigned long ties = 0;
+
+    Header *column = (Header *)corner->e.right;
+    for (; column != corner; column = (Header *)column->e.right) {
+        double a, b;
+        if (!best) {
+            best = column;
+            ties = 1;
+            continue;
+        }
+        a = (double)column->count * best->weight;
+        b = (double)best->count * column->weight;
+        if (a < b || (a == b && best->priority > column->priority)) {
+            best = column;
+            ties = 1;
+        } else if (a == b && best->priority == column->priority && state &&
+                   next_random(state) % ++ties == 0) {
+            best = column;
+        }
+    }
+
+    return best;
+}
+
+/* Put the rows in a column's list in a random order.  scratch must hold
+ * column->count elements. */
+static void
+shuffle_column(Header *column, unsigned long *state, Element **scratch)
+{
+    Element *e;
+    int n = 0;
+    int i;
+
+    for (e = column->e.down; e != &column->e; e = e->down)
+        scratch[n++] = e;
+    for (i = n - 1; i > 0; i--) {
+        int j = (int)(next_random(state) % (unsigned long)(i + 1));
+        e = scratch[i];
+        scratch[i] = scratch[j];
+        scratch[j] = e;
+    }
+
+    e = &column->e;
+    for (i = 0; i < n; i++) {
+        e->down = scratch[i];
+        scratch[i]->up = e;
+        e = scratch[i];
+    }
+    e->down = &column->e;
+    column->e.up = e;
+}
+
+/* The i-th term, from 1, of the Luby sequence: 1 1 2 1 1 2 4 1 1 2 ... */
+static unsigned long
+luby(unsigned long i)
+{
+    for (;;) {
+        int k = 1;
+        while ((1UL << k) - 1 < i)
+            k++;
+        if (i == (1UL << k) - 1)
+            return 1UL << (k - 1);
+        i -= (1UL << (k - 1)) - 1;
+    }
+}
+
+/* ------------------------------------------------------------------------ *
+ * Memo                                                                     *
+ * ------------------------------------------------------------------------ */
+
+/* A table of subproblems.  Without colors or bounds, the rows left in the
+ * matrix are exactly those whose columns are all still linked, so the set
+ * of linked columns identifies the subproblem.  The table may be bounded,
+ * in which case the least recently used entry is dropped to make room. */
+#define MEMO_BITS (CHAR_BIT * sizeof(unsigned long))
+
+typedef struct MemoEntryRec MemoEntry;
+
+struct MemoEntryRec
+{
+    MemoEntry *next;
+    MemoEntry *newer;
+    MemoEntry *older;
+    unsigned long hash;
+    long value;
+    PyObject *object;
+    unsigned long key[1];
+};
+
+typedef struct
+{
+    MemoEntry **buckets;
+    unsigned long mask;
+    unsigned long count;
+
+    /* Maximum number of entries, or 0 for no limit, and the entries from
+     * most to least recently used. */
+    unsigned long limit;
+    MemoEntry *newest;
+    MemoEntry *oldest;
+
+    /* Words in a key, and the key of the current subproblem. */
+    int words;
+    unsigned long *key;
+    unsigned long hash;
+} Memo;
+
+/* Returns -1 on failure. */
+static int
+memo_init(Memo *memo, int itemCount, unsigned long limit)
+{
+    memo->count = 0;
+    memo->limit = limit;
+    memo->newest = memo->oldest = NULL;
+    memo->mask = 1023;
+    memo->words = (int)((itemCount + MEMO_BITS - 1) / MEMO_BITS);
+    memo->buckets = PyMem_New(MemoEntry *, memo->mask + 1);
+    memo->key = PyMem_New(unsigned long, memo->words + 1);
+    if (!memo->buckets || !memo->key) {
+        PyMem_Del(memo->buckets);
+        PyMem_Del(memo->key);
+        return -1;
+    }
+    memset(memo->buckets, 0, (memo->mask + 1) * sizeof(MemoEntry *));
+    return 0;
+}
+
+static void
+memo_free(Memo *memo)
+{
+    unsigned long i;
+
+    for (i = 0; i <= memo->mask; i++) {
+        MemoEntry *entry = memo->buckets[i];
+        while (entry) {
+            MemoEntry *next = entry->next;
+            Py_XDECREF(entry->object);
+            PyMem_Free(entry);
+            entry = next;
+        }
+    }
+    PyMem_Del(memo->buckets);
+    PyMem_Del(memo->key);
+}
+
+/* Compute the key of the current subproblem from the linked columns. */
+static void
+memo_signature(Memo *memo, Header *corner, Header *secondary)
+{
+    Element *e;
+    unsigned long hash = 2166136261UL;
+    int i;
+
+    memset(memo->key, 0, memo->words * sizeof(unsigned long));
+    for (e = corner->e.right; e != &corner->e; e = e->right) {
+        int index = ((Header *)e)->index;
+        memo->key[index / MEMO_BITS] |= 1UL << (index % MEMO_BITS);
+    }
+    for (e = secondary->e.right; e != &secondary->e; e = e->right) {
+        int index = ((Header *)e)->index;
+        memo->key[index / MEMO_BITS] |= 1UL << (index % MEMO_BITS);
+    }
+
+    /* FNV-1a over the words. */
+    for (i = 0; i < memo->words; i++) {
+        hash ^= memo->key[i];
+        hash *= 16777619UL;
+    }
+    memo->hash = hash;
+}
+
+static void
+memo_unlink(Memo *memo, MemoEntry *entry)
+{
+    if (entry->newer)
+        entry->newer->older = entry->older;
+    else
+        memo->newest = entry->older;
+    if (entry->older)
+        entry->older->newer = entry->newer;
+    else
+        memo->oldest = entry->newer;
+}
+
+static void
+memo_link(Memo *memo, MemoEntry *entry)
+{
+    entry->newer = NULL;
+    entry->older = memo->newest;
+    if (memo->newest)
+        memo->newest->newer = entry;
+    else
+        memo->oldest = entry;
+    memo->newest = entry;
+}
+
+/* Find the entry for the current key, or NULL. */
+static MemoEntry *
+memo_lookup(Memo *memo)
+{
+    MemoEntry *entry = memo->buckets[memo->hash & memo->mask];
+    for (; entry; entry = entry->next) {
+        if (entry->hash == memo->hash &&
+            memcmp(entry->key, memo->key,
+                   memo->words * sizeof(unsigned long)) == 0) {
+            if (memo->limit) {
+                memo_unlink(memo, entry);
+                memo_link(memo, entry);
+            }
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+/* Drop the least recently used entry. */
+static void
+memo_evict(Memo *memo)
+{
+    MemoEntry *entry = memo->oldest;
+    MemoEntry **p = &memo->buckets[entry->hash & memo->mask];
+
+    while (*p != entry)
+        p = &(*p)->next;
+    *p = entry->next;
+    memo_unlink(memo, entry);
+    memo->count--;
+    Py_XDECREF(entry->object);
+    PyMem_Free(entry);
+}
+
+/* Add an entry for the current key, taking a reference to object if it is
+ * not NULL.  Returns NULL on failure. */
+static MemoEntry *
+memo_insert(Memo *memo, long value, PyObject *object)
+{
+    MemoEntry *entry;
+
+    if (memo->limit && memo->count >= memo->limit)
+        memo_evict(memo);
+
+    /* Double the buckets when the chains get long. */
+    if (memo->count > 2 * memo->mask) {
+        unsigned long mask = 2 * memo->mask + 1;
+        MemoEntry **buckets = PyMem_New(MemoEntry *, mask + 1);
+        unsigned long i;
+
+        if (buckets) {
+            memset(buckets, 0, (mask + 1) * sizeof(MemoEntry *));
+            for (i = 0; i <= memo->mask; i++) {
+                while ((entry = memo->buckets[i])) {
+                    memo->buckets[i] = entry->next;
+                    entry->next = buckets[entry->hash & mask];
+                    buckets[entry->hash & mask] = entry;
+                }
+            }
+            PyMem_Del(memo->buckets);
+            memo->buckets = buckets;
+            memo->mask = mask;
+        }
+    }
+
+    entry = (MemoEntry *)PyMem_Malloc(sizeof(MemoEntry) +
+                                      memo->words * sizeof(unsigned long));
+    if (!entry)
+        return NULL;
+    entry->hash = memo->hash;
+    entry->value = value;
+    entry->object = object;
+    Py_XINCREF(object);
+    memcpy(entry->key, memo->key, memo->words * sizeof(unsigned long));
+    entry->next = memo->buckets[memo->hash & memo->mask];
+    memo->buckets[memo->hash & memo->mask] = entry;
+    if (memo->limit)
+        memo_link(memo, entry);
+    memo->count++;
+    return entry;
+}
+
+/* ------------------------------------------------------------------------ *
+ * Coverings class                                                          *
+ * ------------------------------------------------------------------------ */
+typedef struct {
+    PyObject_HEAD
+
+    /* Sparse matrix representing the problem. */
+    Header *corner;
+
+    /* Header chain of the secondary columns.  They may be covered at most
+     * once, or by any number of rows which agree on a color. */
+    Header *secondary;
+
+    /* Non-zero if next() has never been called. */
+    int first;
+
+    /* A stack representing the current solution.  This has at most
+     * len(universe) elements. */
+    Element **solution;
+    int solutionSize;
+
+    /* The bottom of the solution stack which is never backed out of.  These
+     * entries are the prefix the search was restricted to. */
+    int base;
+
+    /* Allocated size of solution. */
+    int solutionCapacity;
+
+    /* Non-zero if some column has a bound other than exactly once, in which
+     * case the search branches on columns rather than rows.  Each solution
+     * entry is then the row taken for its column, or the column's header if
+     * it takes no more rows.  tweaks holds the rows passed over so far, and
+     * tweakBase the height of tweaks when each level was entered. */
+    int multiplicity;
+
+    /* Non-zero if some row gives a secondary column a color. */
+    int colored;
+
+    Element **tweaks;
+    int tweakSize;
+    int *tweakBase;
+
+    /* Which representation searches.  Dancing cells are built from the
+     * matrix when iteration starts, and the matrix then only holds the
+     * prefix.  layout is the capsule owning their CellsLayout, which forks
+     * share; a fork has cells but no matrix. */
+    int engine;
+    Cells *cells;
+    PyObject *layout;
+
+    /* The first element of every input row, indexed by row.  Empty rows are
+     * NULL. */
+    Element **rows;
+    int rowCount;
+
+    /* Every column header, indexed by Header.index. */
+    Header **items;
+    int itemCount;
+
+    /* With symmetries, the group as groupSize permutations of the rows, one
+     * after another, and the rank of each row for choosing the least
+     * covering of an orbit.  orbitRows is scratch space for three copies of
+     * the solution. */
+    int *group;
+    int groupSize;
+    int *rank;
+    int *orbitRows;
+
+    /* How the next column is chosen. */
+    int heuristic;
+
+    /* With row keys, the rows sorted by key, or else NULL. */
+    int *rowOrder;
+
+    /* With costs, the cost of each row, or else NULL. */
+    double *costs;
+
+    /* With a seed, the state of the random generator, or else 0.  Until the
+     * first solution is found, the search restarts with the rows reshuffled
+     * after budget nodes, growing with each run. */
+    unsigned long random;
+    int restarts;
+    int found;
+    unsigned long nodes;
+    unsigned long budget;
+    unsigned long run;
+
+    /* With a seed, scratch space for shuffling and for saving the base of
+     * the stack over a restart. */
+    Element **scratch;
+    Element **saved;
+
+    /* Size of the orbit of the last solution found, with symmetries. */
+    int orbit;
+
+    /* Steps taken by the iterator so far. */
+    unsigned PY_LONG_LONG steps;
+
+    /* The columns by their objects, and each color seen so far by its
+     * number, kept for rows added later. */
+    ColumnIndex columns;
+    PyObject *colors;
+
+    /* The levels of the search above the prefix when the rows were last
+     * changed, as (column, row) pairs with a row of -1 for a column taking
+     * no more rows, for resolve() to follow again. */
+    int *trail;
+    int trailSize;
+
+    /* Non-zero once reduce() has dropped or forced rows, which editing
+     * cannot take back. */
+    int reduced;
+
+    /* What becomes of identical rows.  Unless they are kept, each is merged
+     * into the first of them: copies holds, for a row kept with copies, a
+     * list of all their objects, and is NULL for every other row, and merged
+     * maps every row to the one it was merged into.  choice is the copy of
+     * each row of the last solution produced, and copyCount how many copies
+     * the row has, for choiceSize rows. */
+    int duplicates;
+    PyObject **copies;
+    int *merged;
+    int *choice;
+    int *copyCount;
+    int choiceSize;
+
+    /* After a relayout, the blocks holding every element and every column
+     * header, which are then not freed one by one. */
+    Element *elements;
+    Header *headers;
+} Coverings;
+
+static char Coverings__doc__[] =
+"Coverings(iterable, prefix=None, secondary=None, bounds=None,\n"
+"          engine='links', symmetries=None, seed=None,\n"
+"          restarts=None, heuristic='smallest', priorities=None,\n"
+"          row_key=None, costs=None, duplicates='keep',\n"
+"          relayout=None) -> Coverings object\n"
+"\n"
+"Compute exact covers.\n"
+"\n"
+"Return an Coverings object whose .next() method returns a tuple of\n"
+"elements from iterable which cover the union of all the elements of\n"
+"iterable.  iterable must yield sequences.\n"
+"\n"
+"While the elements may be mutable, mutating them will have no effect on\n"
+"the results produced.  It is recommended that they remain unchanged\n"
+"during the iteration.\n"
+"\n"
+"If prefix is given, it is a sequence of indices into iterable, and only\n"
+"coverings which include all of those rows are produced.\n"
+"\n"
+"secondary is an iterable of elements which need not be covered, but may\n"
+"be covered at most once.  A row may instead contain a pair (element,\n"
+"color) for a secondary element; any number of rows may then share it as\n"
+"long as they all give it the same color.\n"
+"\n"
+"bounds maps elements to the number of rows which must cover them, either\n"
+"a count or a (min, max) pair.  Other elements are covered exactly once.\n"
+"Each combination of rows is produced once, not once per ordering.\n"
+"\n"
+"engine selects the representation searched: 'links' for dancing links,\n"
+"or 'cells' for dancing cells, which keeps each column's rows in an\n"
+"array.  Both produce the same coverings, though not in the same order.\n"
+"The cells engine does not support bounds or checkpoints, and is slower,\n"
+"by about half on pentominoes: hiding a row touches several arrays, not\n"
+"one node.  It is there for fork(), share() and attach(): its rows and\n"
+"columns are laid out in a block of ints, which searches in other threads\n"
+"and processes can share.\n"
+"\n"
+"symmetries is a sequence of permutations of the elements, each a\n"
+"callable or a mapping (elements it lacks map to themselves), which map\n"
+"the rows onto each other.  Only one covering from each orbit under the\n"
+"group they generate is produced, as a (covering, orbit size) pair.\n"
+"Rows of one column which the group maps onto each other are searched\n"
+"only once, which cuts the work by up to the size of the group.\n"
+"\n"
+"With a seed, the rows of each element are tried in a random order, and\n"
+"ties between elements with the fewest rows are broken at random.\n"
+"restarts, 'luby' or 'geometric', makes the search start over with a new\n"
+"order whenever it runs out of a node budget before the first covering,\n"
+"the budget growing by that sequence.  This evens out the time to the\n"
+"first covering; the rest are then found without restarting.  Both\n"
+"require the links engine.\n"
+"\n"
+"heuristic picks the element to branch on: 'smallest', the one with the\n"
+"fewest rows, 'weighted', the fewest rows for its weight, which grows\n"
+"each time the element is found with no rows left, or 'priority', the\n"
+"first by priorities.  priorities maps elements to keys, lower first,\n"
+"which otherwise break ties; unlisted elements come last.  These require\n"
+"the links engine, and are not used with bounds.\n"
+"\n"
+"row_key is a function of a row whose results order each element's rows,\n"
+"so the likeliest rows are tried first.  It cannot be used with a seed.\n"
+"\n"
+"costs is a sequence giving each row a cost, at least 0; best() then\n"
+"finds the covering of least total cost.\n"
+"\n"
+"duplicates says what becomes of identical rows, those with the same\n"
+"elements and colors.  'keep' searches each of them.  'expand' and 'count'\n"
+"merge them into the first, so the search goes down its branch only once;\n"
+"'expand' then produces each covering once for every choice among the\n"
+"copies of its rows, and 'count' produces it once, as a (covering,\n"
+"multiplicity) pair holding the first copy of each row.  count() counts\n"
+"every choice either way.  A prefix index of a copy stands for the row it\n"
+"was merged into.  Merging does not support bounds, costs, symmetries,\n"
+"zdd(), fork(), share() or editing the rows.\n"
+"\n"
+"relayout, 'count' or 'rcm', renumbers the elements once the rows are\n"
+"read, by their number of rows, fewest first, or in reverse Cuthill-McKee\n"
+"order, which numbers elements sharing rows close together.  The matrix\n"
+"is then packed into memory in that order, with the rows of each element\n"
+"side by side, so the search touches less memory.  Coverings may come in\n"
+"another order.  The rows cannot be edited afterwards.\n";
+
+/* Coverings_step() for columns with multiplicities. */
+static int
+Coverings_bounded_step(Coverings *self)
+{
+    Header *column;
+    int branches;
+
+    column = bounded_column(self->corner, &branches);
+    if (column == NULL) {
+        return SOLUTION;
+    } else if (branches == 0) {
+        return BACKUP;
+    }
+
+    self->tweakBase[self->solutionSize] = self->tweakSize;
+    if (column->count > 0) {
+        Element *row = column->e.down;
+        take_row(row);
+        self->solution[self->solutionSize] = row;
+    } else {
+        unlink_column(column);
+        self->solution[self->solutionSize] = &column->e;
+    }
+    self->solutionSize++;
+
+    return CONTINUE;
+}
+
+/* Undo the tweaks made at the top level of the solution stack. */
+static void
+Coverings_untweak(Coverings *self)
+{
+    int base = self->tweakBase[self->solutionSize - 1];
+    while (self->tweakSize > base)
+        restore_row(self->tweaks[--self->tweakSize]);
+}
+
+/* Coverings_backup() for columns with multiplicities. */
+static int
+Coverings_bounded_backup(Coverings *self)
+{
+    while (self->solutionSize > self->base) {
+        Element *row = self->solution[self->solutionSize - 1];
+        Header *column = row->column;
+
+        if (row == &column->e) {
+            /* Taking nothing more was the last branch. */
+            link_column(column);
+        } else {
+            untake_row(row);
+
+            /* Pass over row for the rest of this level. */
+            remove_row(row);
+            self->tweaks[self->tweakSize++] = row;
+
+            row = column->e.down;
+            if (row != &column->e) {
+                take_row(row);
+                self->solution[self->solutionSize - 1] = row;
+                return 0;
+            } else if (column->bound <= column->slack) {
+                unlink_column(column);
+                self->solution[self->solutionSize - 1] = &column->e;
+                return 0;
+            }
+        }
+        Coverings_untweak(self);
+        self->solutionSize--;
+    }
+    return -1;
+}
+
+/* Make one solving step, returns an Action.
+ *
+ * CONTINUE = Some of the universe is uncovered, call this function again.
+ * BACKUP = The remaining universe cannot be covered, backtrack then call this
+ *          function again.
+ * SOLUTION = solution contains a covering set. */
+static int
+Coverings_step(Coverings *self)
+{
+    Header *column = NULL;
+    Element *row = NULL;
+
+    if (self->cells)
+        return cells_step(self->cells);
+    if (self->multiplicity)
+        return Coverings_bounded_step(self);
+
+    /* New column. */
+    if (self->heuristic == HEURISTIC_WEIGHTED)
+        column = weighted_column(self->corner,
+                                 self->random ? &self->random : NULL);
+    else if (self->heuristic == HEURISTIC_PRIORITY)
+        column = priority_column(self->corner);
+    else if (self->random)
+        column = random_smallest_column(self->corner, &self->random);
+    else
+        column = smallest_column(self->corner);
+    if (column == NULL ) {
+        return SOLUTION;
+    } else if (column->count == 0) {
+        column->weight++;
+        return BACKUP;
+    }
+    row = column->e.down;
+
+    /* Add new row. */
+    unlink_row(row);
+    CHECK(self->corner);
+    self->solution[self->solutionSize] = row;
+    self->solutionSize++;
+
+    return CONTINUE;
+}
+
+/* backtrack.  Returns -1 if there are no more solutions */
+static int
+Coverings_backup(Coverings *self)
+{
+    if (self->cells)
+        return cells_backup(self->cells);
+    if (self->multiplicity)
+        return Coverings_bounded_backup(self);
+
+    while (self->solutionSize > self->base) {
+        Element *row = self->solution[self->solutionSize - 1];
+        link_row(row);
+        CHECK(self->corner);
+        row = row->down;
+        if (row == &row->column->e) {
+            self->solutionSize--;
+        } else {
+            unlink_row(row);
+            CHECK(self->corner);
+            self->solution[self->solutionSize - 1] = row;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Create a tuple of the current solution stack. */
+static PyObject *
+Coverings_solution(Coverings *self)
+{
+    PyObject *tuple;
+    Cells *cells = self->cells;
+    int size = 0;
+    int i;
+
+    /* Column headers on the stack are not rows. */
+    for (i = 0; i < self->solutionSize; i++)
+        size += self->solution[i]->row >= 0;
+    if (cells)
+        size += cells->depth;
+
+    tuple = PyTuple_New(size);
+    if (!tuple)
+        return NULL;
+
+    size = 0;
+    for (i = 0; i < self->solutionSize; i++) {
+        Element *row = self->solution[i];
+        PyObject *object = row->object;
+        if (!object)
+            continue;
+        if (self->copies && self->copies[row->row])
+            object = PyList_GET_ITEM(self->copies[row->row],
+                                     self->choice[size]);
+        Py_INCREF(object);
+        PyTuple_SET_ITEM(tuple, size, object);
+        size++;
+    }
+    for (i = 0; cells && i < cells->depth; i++) {
+        int node = cells->set[cells->first[cells->levelItem[i]] +
+                              cells->levelPos[i]];
+        const CellsLayout *layout = cells->layout;
+        int r = layout->index[cells->owner[node]];
+        PyObject *object;
+
+        if (self->copies && self->copies[r]) {
+            object = PyList_GET_ITEM(self->copies[r], self->choice[size]);
+            Py_INCREF(object);
+        } else if (layout->objects) {
+            object = layout->objects[cells->owner[node]];
+            Py_INCREF(object);
+        } else if (!(object = PyInt_FromLong(r))) {
+            Py_DECREF(tuple);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(tuple, size, object);
+        size++;
+    }
+    return tuple;
+}
+
+/* Pop the top of the solution stack, restoring the matrix. */
+static void
+Coverings_pop(Coverings *self)
+{
+    Element *row = self->solution[self->solutionSize - 1];
+
+    if (!self->multiplicity) {
+        link_row(row);
+    } else {
+        if (row == &row->column->e)
+            link_column(row->column);
+        else
+            untake_row(row);
+        Coverings_untweak(self);
+    }
+    self->solutionSize--;
+}
+
+static void
+Coverings_cleanup(Coverings *self)
+{
+    if (self->corner) {
+        /* restore matrix */
+        while (self->solutionSize > 0)
+            Coverings_pop(self);
+    }
+
+    free_cells(self->cells);
+    Py_CLEAR(self->layout);
+    if (self->rows)
+        free_rows(self->rows, self->rowCount, self->elements != NULL);
+    if (self->copies) {
+        int i;
+        for (i = 0; i < self->rowCount; i++)
+            Py_XDECREF(self->copies[i]);
+    }
+    free_matrix(self->corner, self->headers != NULL);
+    free_matrix(self->secondary, self->headers != NULL);
+    PyMem_Del(self->elements);
+    PyMem_Del(self->headers);
+    self->elements = NULL;
+    self->headers = NULL;
+    PyMem_Del(self->solution);
+    PyMem_Del(self->tweaks);
+    PyMem_Del(self->tweakBase);
+    PyMem_Del(self->rows);
+    PyMem_Del(self->items);
+    PyMem_Del(self->group);
+    PyMem_Del(self->rank);
+    PyMem_Del(self->orbitRows);
+    PyMem_Del(self->rowOrder);
+    PyMem_Del(self->costs);
+    PyMem_Del(self->scratch);
+    PyMem_Del(self->saved);
+    self->corner = NULL;
+    self->secondary = NULL;
+    self->solution = NULL;
+    self->solutionSize = 0;
+    self->solutionCapacity = 0;
+    self->base = 0;
+    self->multiplicity = 0;
+    self->colored = 0;
+    self->tweaks = NULL;
+    self->tweakSize = 0;
+    self->tweakBase = NULL;
+    self->cells = NULL;
+    self->rows = NULL;
+    self->rowCount = 0;
+    self->items = NULL;
+    self->itemCount = 0;
+    self->group = NULL;
+    self->groupSize = 0;
+    self->rank = NULL;
+    self->orbitRows = NULL;
+    self->heuristic = HEURISTIC_SMALLEST;
+    self->rowOrder = NULL;
+    self->costs = NULL;
+    self->random = 0;
+    self->restarts = RESTART_NONE;
+    self->found = 0;
+    self->nodes = 0;
+    self->budget = 0;
+    self->run = 0;
+    self->scratch = NULL;
+    self->saved = NULL;
+    self->orbit = 0;
+    self->steps = 0;
+    Py_CLEAR(self->columns.dict);
+    self->columns.unhashable = 0;
+    Py_CLEAR(self->colors);
+    PyMem_Del(self->trail);
+    self->trail = NULL;
+    self->trailSize = 0;
+    self->reduced = 0;
+    PyMem_Del(self->copies);
+    PyMem_Del(self->merged);
+    PyMem_Del(self->choice);
+    PyMem_Del(self->copyCount);
+    self->duplicates = DUPLICATES_KEEP;
+    self->copies = NULL;
+    self->merged = NULL;
+    self->choice = NULL;
+    self->copyCount = NULL;
+    self->choiceSize = 0;
+}
+
+static int Coverings_orbit(Coverings *self);
+static int Coverings_choose(Coverings *self, Element *e);
+
+/* Shuffle the rows of every column.  Every row left must be in its columns,
+ * so nothing may be on the solution stack. */
+static void
+Coverings_shuffle(Coverings *self)
+{
+    int i;
+
+    for (i = 0; i < self->itemCount; i++)
+        shuffle_column(self->items[i], &self->random, self->scratch);
+}
+
+/* Start the search again with the rows reshuffled, and a larger budget. */
+static void
+Coverings_restart(Coverings *self)
+{
+    int size = self->base;
+
+    memcpy(self->saved, self->solution, size * sizeof(Element *));
+    while (self->solutionSize > 0)
+        Coverings_pop(self);
+    Coverings_shuffle(self);
+    for (self->base = 0; self->base < size; self->base++)
+        Coverings_choose(self, self->saved[self->base]);
+
+    self->run++;
+    self->nodes = 0;
+    if (self->restarts == RESTART_LUBY)
+        self->budget = RESTART_UNIT * luby(self->run);
+    else
+        self->budget += self->budget / 2;
+}
+
+/* Prepare for the first step of the search.  Returns -1 on failure. */
+static int
+Coverings_start(Coverings *self)
+{
+    if (self->engine == ENGINE_CELLS && !self->cells) {
+        if (!self->layout &&
+            !(self->layout = alloc_layout(self->corner, self->secondary,
+                                          self->rows, self->rowCount,
+                                          self->itemCount, self->rowOrder)))
+            return -1;
+        if (!(self->cells = alloc_cells(self->layout)))
+            return -1;
+    }
+    self->first = 0;
+    return 0;
+}
+
+/* Search on to the next solution, or until *cancel becomes non-zero if cancel
+ * is not NULL.  This touches no Python objects, so it may run without the
+ * GIL. */
+static int
+Coverings_search(Coverings *self, volatile int *cancel)
+{
+    for (;;) {
+        if (cancel && *cancel)
+            return SEARCH_CANCELLED;
+        if (self->restarts && !self->found && ++self->nodes > self->budget)
+            Coverings_restart(self);
+
+        self->steps++;
+        switch (Coverings_step(self)) {
+        case CONTINUE:
+            break;
+
+        case BACKUP:
+            if (Coverings_backup(self) < 0)
+                return SEARCH_DONE;
+            break;
+
+        case SOLUTION:
+            self->found = 1;
+            if (self->group && !(self->orbit = Coverings_orbit(self))) {
+                if (Coverings_backup(self) < 0)
+                    return SEARCH_DONE;
+                break;
+            }
+            return SEARCH_FOUND;
+        }
+    }
+}
+
+/* Number of copies of row r. */
+static int
+Coverings_copies(Coverings *self, int r)
+{
+    return self->copies[r] ? (int)PyList_GET_SIZE(self->copies[r]) : 1;
+}
+
+/* Choose the first copy of each row of the solution found. */
+static void
+Coverings_first_copies(Coverings *self)
+{
+    Cells *cells = self->cells;
+    int size = 0;
+    int i;
+
+    for (i = 0; i < self->solutionSize; i++) {
+        int r = self->solution[i]->row;
+        if (r >= 0)
+            self->copyCount[size++] = Coverings_copies(self, r);
+    }
+    for (i = 0; cells && i < cells->depth; i++) {
+        int node = cells->set[cells->first[cells->levelItem[i]] +
+                              cells->levelPos[i]];
+        self->copyCount[size++] =
+            Coverings_copies(self, cells->layout->index[cells->owner[node]]);
+    }
+    memset(self->choice, 0, size * sizeof(int));
+    self->choiceSize = size;
+}
+
+/* Choose the next combination of copies of the rows of the solution, in
+ * the order of an odometer.  Returns 0 once they have all been chosen. */
+static int
+Coverings_next_copies(Coverings *self)
+{
+    int i;
+
+    for (i = self->choiceSize - 1; i >= 0; i--) {
+        if (++self->choice[i] < self->copyCount[i])
+            return 1;
+        self->choice[i] = 0;
+    }
+    self->choiceSize = 0;
+    return 0;
+}
+
+/* Multiply count, which is stolen, by factor.  Returns a new reference, or
+ * NULL on failure. */
+static PyObject *
+times(PyObject *count, Py_ssize_t factor)
+{
+    PyObject *number;
+    PyObject *product;
+
+    if (!count || factor == 1)
+        return count;
+    number = PyInt_FromSsize_t(factor);
+    product = number ? PyNumber_Multiply(count, number) : NULL;
+    Py_XDECREF(number);
+    Py_DECREF(count);
+    return product;
+}
+
+/* Return the solution found by Coverings_search(). */
+static PyObject *
+Coverings_found(Coverings *self)
+{
+    if (self->duplicates != DUPLICATES_KEEP)
+        Coverings_first_copies(self);
+    if (self->group)
+        return Py_BuildValue("(Ni)", Coverings_solution(self), self->orbit);
+    if (self->duplicates == DUPLICATES_COUNT) {
+        PyObject *multiplicity = PyInt_FromLong(1);
+        int i;
+
+        for (i = 0; i < self->choiceSize; i++)
+            multiplicity = times(multiplicity, self->copyCount[i]);
+        if (!multiplicity)
+            return NULL;
+        return Py_BuildValue("(NN)", Coverings_solution(self), multiplicity);
+    }
+    return Coverings_solution(self);
+}
+
+/* .next() */
+static PyObject *
+Coverings_next(Coverings *self)
+{
+    /* We need to backup from the last solution on every new iteration. */
+    if (self->first) {
+        if (Coverings_start(self) < 0)
+            return NULL;
+    } else if (self->duplicates == DUPLICATES_EXPAND &&
+               Coverings_next_copies(self)) {
+        return Coverings_solution(self);
+    } else if (Coverings_backup(self) < 0) {
+        return NULL;
+    }
+
+    if (Coverings_search(self, NULL) != SEARCH_FOUND)
+        return NULL;
+    return Coverings_found(self);
+}
+
+/* ------------------------------------------------------------------------ *
+ * Checkpoints                                                              *
+ * ------------------------------------------------------------------------ */
+
+/* A checkpoint is a sequence of little-endian 32 bit words:
+ *
+ *   magic, flags, row count, column count, depth, base,
+ *   then (column, row) for each entry of the solution stack,
+ *   then, with CHECKPOINT_COPIES, the copy chosen of each row of it.
+ *
+ * The column is recorded along with the row, so replaying does not depend on
+ * the column heuristic. */
+#define CHECKPOINT_MAGIC 0x31435845UL /* "EXC1" */
+#define CHECKPOINT_HEADER 6
+
+/* flags */
+#define CHECKPOINT_STARTED 0x1
+#define CHECKPOINT_COPIES 0x2
+
+static void
+put_word(unsigned char *p, unsigned long word)
+{
+    p[0] = (unsigned char)(word & 0xff);
+    p[1] = (unsigned char)((word >> 8) & 0xff);
+    p[2] = (unsigned char)((word >> 16) & 0xff);
+    p[3] = (unsigned char)((word >> 24) & 0xff);
+}
+
+static unsigned long
+get_word(const unsigned char *p)
+{
+    return (unsigned long)p[0] |
+           ((unsigned long)p[1] << 8) |
+           ((unsigned long)p[2] << 16) |
+           ((unsigned long)p[3] << 24);
+}
+
+/* Find the element of row in column, or NULL if it is not there. */
+static Element *
+row_element(Element *row, Header *column)
+{
+    Element *e = row;
+    do {
+        if (e->column == column)
+            return e;
+        e = e->right;
+    } while (e != row);
+    return NULL;
+}
+
+/* Push e's row on the solution stack, exactly as Coverings_step() would
+ * have if it chose e's column.  Returns 0 if the row is not currently
+ * available. */
+static int
+Coverings_choose(Coverings *self, Element *e)
+{
+    if (!e || !row_available(e) ||
+        self->solutionSize >= self->solutionCapacity)
+        return 0;
+
+    if (self->multiplicity) {
+        /* Take the row for one of its primary columns. */
+        Element *row = e;
+        while (e->color || e->column->bound < 0) {
+            e = e->right;
+            if (e == row)
+                return 0;
+        }
+        self->tweakBase[self->solutionSize] = self->tweakSize;
+        take_row(e);
+    } else {
+        unlink_row(e);
+    }
+    CHECK(self->corner);
+    self->solution[self->solutionSize] = e;
+    self->solutionSize++;
+    return 1;
+}
+
+/* Replay one level of a search with multiplicities, passing over rows of
+ * column until reaching row, or taking nothing more if row is the header. */
+static int
+Coverings_bounded_replay(Coverings *self, Header *column, Element *row)
+{
+    if (!row || column->bound < 0 ||
+        column->e.left->right != &column->e ||
+        self->solutionSize >= self->solutionCapacity)
+        return 0;
+
+    self->tweakBase[self->solutionSize] = self->tweakSize;
+    while (column->e.down != row) {
+        if (column->e.down == &column->e)
+            goto fail;
+        self->tweaks[self->tweakSize++] = column->e.down;
+        remove_row(column->e.down);
+    }
+
+    if (row == &column->e) {
+        if (column->bound > column->slack)
+            goto fail;
+        unlink_column(column);
+    } else {
+        take_row(row);
+    }
+    self->solution[self->solutionSize] = row;
+    self->solutionSize++;
+    return 1;
+
+fail:
+    /* Put back the rows passed over. */
+    while (self->tweakSize > self->tweakBase[self->solutionSize])
+        restore_row(self->tweaks[--self->tweakSize]);
+    return 0;
+}
+
+/* Replay a (column, row) checkpoint entry.  Entries above the base were
+ * reached by searching, rather than given as a prefix.  Returns -1 with an
+ * exception set if the row is not currently available in that column. */
+static int
+Coverings_replay(Coverings *self, int item, int index, int searched)
+{
+    Header *column;
+    Element *row = NULL;
+    int ok;
+
+    if (item < 0 || item >= self->itemCount ||
+        index < -1 || index >= self->rowCount)
+        goto error;
+    column = self->items[item];
+    if (index == -1)
+        row = &column->e;
+    else if (self->rows[index])
+        row = row_element(self->rows[index], column);
+
+    if (self->multiplicity && searched)
+        ok = Coverings_bounded_replay(self, column, row);
+    else
+        ok = index >= 0 && Coverings_choose(self, row);
+    if (ok)
+        return 0;
+
+error:
+    PyErr_SetString(PyExc_ValueError, "checkpoint does not match rows");
+    return -1;
+}
+
+static char Coverings_checkpoint__doc__[] =
+"checkpoint() -> bytes\n"
+"\n"
+"Return the current search position in a compact form.  Passing it to\n"
+"Coverings.resume() along with the same rows and constructor arguments\n"
+"continues the iteration where this object left off.\n";
+
+/* .checkpoint() */
+static PyObject *
+Coverings_checkpoint(Coverings *self)
+{
+    PyObject *bytes;
+    unsigned char *p;
+    int choices = 0;
+    int i;
+
+    if (self->cells) {
+        PyErr_SetString(PyExc_ValueError,
+                        "the cells engine cannot checkpoint a running search");
+        return NULL;
+    }
+    if (self->restarts && self->run > 1) {
+        PyErr_SetString(PyExc_ValueError,
+                        "cannot checkpoint a search which has restarted");
+        return NULL;
+    }
+
+    if (self->duplicates == DUPLICATES_EXPAND)
+        choices = self->choiceSize;
+
+    bytes = PyBytes_FromStringAndSize(NULL,
+        4 * (CHECKPOINT_HEADER + 2 * self->solutionSize + choices));
+    if (!bytes)
+        return NULL;
+    p = (unsigned char *)PyBytes_AS_STRING(bytes);
+
+    put_word(p, CHECKPOINT_MAGIC);
+    put_word(p + 4, (self->first ? 0 : CHECKPOINT_STARTED) |
+                    (choices ? CHECKPOINT_COPIES : 0));
+    put_word(p + 8, self->rowCount);
+    put_word(p + 12, self->itemCount);
+    put_word(p + 16, self->solutionSize);
+    put_word(p + 20, self->base);
+    p += 4 * CHECKPOINT_HEADER;
+
+    for (i = 0; i < self->solutionSize; i++) {
+        put_word(p, self->solution[i]->column->index);
+        put_word(p + 4, (unsigned long)self->solution[i]->row & 0xffffffffUL);
+        p += 8;
+    }
+    for (i = 0; i < choices; i++) {
+        put_word(p, self->choice[i]);
+        p += 4;
+    }
+    return bytes;
+}
+
+/* Restore a checkpoint into a freshly initialized object. */
+static int
+Coverings_restore(Coverings *self, const unsigned char *p, Py_ssize_t len)
+{
+    unsigned long flags;
+    unsigned long depth;
+    unsigned long base;
+    unsigned long choices;
+    unsigned long i;
+
+    if (len < 4 * CHECKPOINT_HEADER ||
+        get_word(p) != CHECKPOINT_MAGIC) {
+        PyErr_SetString(PyExc_ValueError, "not a checkpoint");
+        return -1;
+    }
+    flags = get_word(p + 4);
+    depth = get_word(p + 16);
+    base = get_word(p + 20);
+    choices = (unsigned long)len / 4 - CHECKPOINT_HEADER - 2 * depth;
+    if (get_word(p + 8) != (unsigned long)self->rowCount ||
+        get_word(p + 12) != (unsigned long)self->itemCount ||
+        depth > (unsigned long)self->solutionCapacity || base > depth ||
+        (self->engine == ENGINE_CELLS && base != depth) ||
+        (unsigned long)len < 4 * (CHECKPOINT_HEADER + 2 * depth) ||
+        (unsigned long)len % 4 != 0 ||
+        (choices && (!(flags & CHECKPOINT_COPIES) ||
+                     self->duplicates != DUPLICATES_EXPAND))) {
+        PyErr_SetString(PyExc_ValueError, "checkpoint does not match rows");
+        return -1;
+    }
+    p += 4 * CHECKPOINT_HEADER;
+
+    for (i = 0; i < depth; i++) {
+        unsigned long row = get_word(p + 4);
+        if (Coverings_replay(self, (int)get_word(p),
+                             row == 0xffffffffUL ? -1 : (int)row,
+                             i >= base) < 0)
+            return -1;
+        p += 8;
+    }
+    self->base = (int)base;
+    self->first = !(flags & CHECKPOINT_STARTED);
+
+    /* The rows on the stack are the covering whose copies were last being
+     * produced. */
+    if (choices) {
+        Coverings_first_copies(self);
+        if (choices != (unsigned long)self->choiceSize) {
+            PyErr_SetString(PyExc_ValueError,
+                            "checkpoint does not match rows");
+            return -1;
+        }
+        for (i = 0; i < choices; i++) {
+            unsigned long choice = get_word(p + 4 * i);
+            if (choice >= (unsigned long)self->copyCount[i]) {
+                PyErr_SetString(PyExc_ValueError,
+                                "checkpoint does not match rows");
+                return -1;
+            }
+            self->choice[i] = (int)choice;
+        }
+    }
+    return 0;
+}
+
+static char Coverings_resume__doc__[] =
+"Coverings.resume(rows, checkpoint, **kwds) -> Coverings object\n"
+"\n"
+"Rebuild the search described by checkpoint, which was returned by\n"
+"checkpoint() on a Coverings object over the same rows.  kwds are passed\n"
+"to the constructor, and must repeat the arguments that object was made\n"
+"with, such as secondary, bounds, seed, heuristic, priorities, row_key,\n"
+"duplicates and relayout, as the search is replayed over the matrix they\n"
+"build.  The exception is prefix, which the checkpoint holds: it need not\n"
+"be repeated, and if it is, it must name the same rows.\n";
+
+/* Check that prefix, given to resume() as well as a checkpoint, names the
+ * rows of the restored prefix, in any order.  Returns -1 with an exception
+ * set if not. */
+static int
+Coverings_check_prefix(Coverings *self, PyObject *prefix)
+{
+    PyObject *fast;
+    char *matched = NULL;
+    Py_ssize_t k;
+    int result = -1;
+    int i;
+
+    if (!(fast = PySequence_Fast(prefix, "prefix must be a sequence")))
+        return -1;
+    if (PySequence_Fast_GET_SIZE(fast) != self->base)
+        goto mismatch;
+    if (!(matched = PyMem_New(char, self->base + 1))) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    memset(matched, 0, self->base + 1);
+
+    /* Each index must name a row of the prefix not named before. */
+    for (k = 0; k < self->base; k++) {
+        long index = PyInt_AsLong(PySequence_Fast_GET_ITEM(fast, k));
+        if (index == -1 && PyErr_Occurred())
+            goto done;
+        if (index < 0 || index >= self->rowCount)
+            goto mismatch;
+        if (self->merged)
+            index = self->merged[index];
+        for (i = 0; i < self->base; i++) {
+            if (!matched[i] && self->solution[i]->row == index)
+                break;
+        }
+        if (i == self->base)
+            goto mismatch;
+        matched[i] = 1;
+    }
+    result = 0;
+    goto done;
+
+mismatch:
+    PyErr_SetString(PyExc_ValueError, "prefix does not match checkpoint");
+done:
+    PyMem_Del(matched);
+    Py_DECREF(fast);
+    return result;
+}
+
+/* Coverings.resume() */
+static PyObject *
+Coverings_resume(PyObject *type, PyObject *args, PyObject *kwds)
+{
+    PyObject *rows;
+    PyObject *ctorArgs;
+    PyObject *ctorKwds = NULL;
+    PyObject *prefix = NULL;
+    PyObject *self;
+    Py_buffer checkpoint;
+
+    if (!PyArg_ParseTuple(args, "Os*:resume", &rows, &checkpoint))
+        return NULL;
+
+    /* The checkpoint holds the prefix, so it is not passed on. */
+    if (kwds && (prefix = PyDict_GetItemString(kwds, "prefix"))) {
+        Py_INCREF(prefix);
+        if (!(ctorKwds = PyDict_Copy(kwds)) ||
+            PyDict_DelItemString(ctorKwds, "prefix") < 0) {
+            Py_XDECREF(ctorKwds);
+            Py_DECREF(prefix);
+            PyBuffer_Release(&checkpoint);
+            return NULL;
+        }
+    } else {
+        Py_XINCREF(kwds);
+        ctorKwds = kwds;
+    }
+
+    ctorArgs = PyTuple_Pack(1, rows);
+    if (!ctorArgs) {
+        Py_XDECREF(ctorKwds);
+        Py_XDECREF(prefix);
+        PyBuffer_Release(&checkpoint);
+        return NULL;
+    }
+    self = PyObject_Call(type, ctorArgs, ctorKwds);
+    Py_DECREF(ctorArgs);
+    Py_XDECREF(ctorKwds);
+
+    if (self && Coverings_restore((Coverings *)self,
+                                  (const unsigned char *)checkpoint.buf,
+                                  checkpoint.len) < 0)
+        Py_CLEAR(self);
+    if (self && prefix && prefix != Py_None &&
+        Coverings_check_prefix((Coverings *)self, prefix) < 0)
+        Py_CLEAR(self);
+
+    Py_XDECREF(prefix);
+    PyBuffer_Release(&checkpoint);
+    return self;
+}
+
+/* ------------------------------------------------------------------------ *
+ * Splitting                                                                *
+ * ------------------------------------------------------------------------ */
+
+/* Forks have no matrix of their own, just cells over a shared layout.
+ * Returns 0 with an exception set if self is one. */
+static int
+Coverings_has_matrix(Coverings *self, const char *method)
+{
+    if (self->corner)
+        return 1;
+    PyErr_Format(PyExc_ValueError, "a fork does not support %s()", method);
+    return 0;
+}
+
+/* Append the rows of the solution stack to list as a tuple of indices. */
+static int
+Coverings_append_prefix(Coverings *self, PyObject *list)
+{
+    PyObject *prefix;
+    int i;
+    int result;
+
+    prefix = PyTuple_New(self->solutionSize);
+    if (!prefix)
+        return -1;
+    for (i = 0; i < self->solutionSize; i++) {
+        PyObject *index = PyInt_FromLong(self->solution[i]->row);
+        if (!index) {
+            Py_DECREF(prefix);
+            return -1;
+        }
+        PyTuple_SET_ITEM(prefix, i, index);
+    }
+    result = PyList_Append(list, prefix);
+    Py_DECREF(prefix);
+    return result;
+}
+
+/* Append every live node depth levels below the current one to list.  Nodes
+ * that are already solutions are appended as they are found.  *cut is set if
+ * any node still had uncovered columns. */
+static int
+Coverings_split_level(Coverings *self, int depth, PyObject *list, int *cut)
+{
+    Header *column = smallest_column(self->corner);
+    Element *row;
+
+    if (column && column->count == 0)
+        return 0;
+    if (!column || depth == 0) {
+        if (column)
+            *cut = 1;
+        return Coverings_append_prefix(self, list);
+    }
+
+    for (row = column->e.down; row != &column->e; row = row->down) {
+        int result;
+
+        unlink_row(row);
+        self->solution[self->solutionSize++] = row;
+        result = Coverings_split_level(self, depth - 1, list, cut);
+        self->solutionSize--;
+        link_row(row);
+        if (result < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static char Coverings_split__doc__[] =
+"split(depth=None, jobs=None) -> list of prefixes\n"
+"\n"
+"Divide the remaining search into disjoint subtrees.  Each prefix is a\n"
+"tuple of row indices; Coverings(rows, prefix=prefix) searches exactly\n"
+"that subtree, and together they produce every covering once.\n"
+"\n"
+"With depth, the tree is cut that many levels down.  With jobs, it is\n"
+"cut at the shallowest level that yields at least that many prefixes.\n"
+"Must be called before iteration starts.\n";
+
+/* .split() */
+static PyObject *
+Coverings_split(Coverings *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"depth", "jobs", NULL};
+    PyObject *list = NULL;
+    int depth = -1;
+    int jobs = -1;
+    int cut = 1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|ii:split", kwlist,
+                                     &depth, &jobs))
+        return NULL;
+    if (!Coverings_has_matrix(self, "split"))
+        return NULL;
+    if ((depth < 0) == (jobs < 0)) {
+        PyErr_SetString(PyExc_TypeError,
+                        "split() takes exactly one of depth or jobs");
+        return NULL;
+    }
+    if (!self->first) {
+        PyErr_SetString(PyExc_ValueError,
+                        "split() must be called before iteration");
+        return NULL;
+    }
+    if (self->multiplicity || self->group) {
+        PyErr_SetString(PyExc_ValueError,
+                        "split() does not support bounds or symmetries");
+        return NULL;
+    }
+
+    if (depth >= 0) {
+        list = PyList_New(0);
+        if (list && Coverings_split_level(self, depth, list, &cut) < 0)
+            Py_CLEAR(list);
+        return list;
+    }
+
+    /* Deepen until there are enough jobs or the whole tree is covered. */
+    for (depth = 0; cut; depth++) {
+        Py_XDECREF(list);
+        list = PyList_New(0);
+        cut = 0;
+        if (!list || Coverings_split_level(self, depth, list, &cut) < 0) {
+            Py_XDECREF(list);
+            return NULL;
+        }
+        if (PyList_GET_SIZE(list) >= jobs)
+            break;
+    }
+    return list;
+}
+
+/* The capsule of the layout shared by self and its forks, made if need be.
+ * Returns NULL with an exception set if self cannot share one. */
+static PyObject *
+Coverings_shared_layout(Coverings *self, const char *method)
+{
+    if (!self->first) {
+        PyErr_Format(PyExc_ValueError,
+                     "%s() must be called before iteration", method);
+        return NULL;
+    }
+    if (self->solutionSize > 0 || (self->cells && self->cells->base > 0) ||
+        self->multiplicity || self->group || self->copies) {
+        PyErr_Format(PyExc_ValueError, "%s() does not support a prefix, "
+                     "bounds, symmetries or merged duplicates", method);
+        return NULL;
+    }
+    if (!self->layout &&
+        !(self->layout = alloc_layout(self->corner, self->secondary,
+                                      self->rows, self->rowCount,
+                                      self->itemCount, self->rowOrder)))
+        return NULL;
+    return self->layout;
+}
+
+/* Make a fork of type searching the layout owned by capsule, below prefix
+ * unless it is None. */
+static PyObject *
+Coverings_new_fork(PyTypeObject *type, PyObject *capsule, PyObject *prefix)
+{
+    PyObject *it = NULL;
+    PyObject *elem = NULL;
+    Coverings *fork;
+    const CellsLayout *layout;
+
+    fork = (Coverings *)type->tp_alloc(type, 0);
+    if (!fork)
+        return NULL;
+    fork->engine = ENGINE_CELLS;
+    fork->heuristic = HEURISTIC_SMALLEST;
+    fork->first = 1;
+    Py_INCREF(capsule);
+    fork->layout = capsule;
+    if (!(fork->cells = alloc_cells(fork->layout)))
+        goto error;
+    layout = fork->cells->layout;
+
+    if (prefix != Py_None) {
+        if (!(it = PyObject_GetIter(prefix)))
+            goto error;
+        while ((elem = PyIter_Next(it))) {
+            long index = PyInt_AsLong(elem);
+            if (index == -1 && PyErr_Occurred())
+                goto error;
+            if (index < 0 || index >= layout->inputCount ||
+                layout->row[index] < 0 ||
+                !cells_choose(fork->cells, layout->row[index])) {
+                PyErr_SetString(PyExc_ValueError,
+                                "prefix is not a partial covering");
+                goto error;
+            }
+            Py_CLEAR(elem);
+        }
+        Py_CLEAR(it);
+        if (PyErr_Occurred())
+            goto error;
+    }
+    return (PyObject *)fork;
+
+error:
+    Py_XDECREF(elem);
+    Py_XDECREF(it);
+    Py_DECREF(fork);
+    return NULL;
+}
+
+static char Coverings_fork__doc__[] =
+"fork(prefix=None) -> Coverings object\n"
+"\n"
+"Return a new iterator over the coverings of the same rows, searched with\n"
+"dancing cells, which shares their layout with this object and all its\n"
+"other forks.  Each fork holds only its own search state, a couple of\n"
+"integers per entry of the rows, so running one per prefix from split(),\n"
+"even on many threads, costs little more than one search.  prefix is as\n"
+"for Coverings().\n"
+"\n"
+"Must be called before iteration, and does not support a prefix, bounds\n"
+"or symmetries on this object.  A fork supports only iteration, fork()\n"
+"and share().\n";
+
+/* .fork() */
+static PyObject *
+Coverings_fork(Coverings *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"prefix", NULL};
+    PyObject *prefix = Py_None;
+    PyObject *capsule;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O:fork", kwlist,
+                                     &prefix))
+        return NULL;
+    if (!(capsule = Coverings_shared_layout(self, "fork")))
+        return NULL;
+    return Coverings_new_fork(Py_TYPE(self), capsule, prefix);
+}
+
+static char Coverings_share__doc__[] =
+"share() -> bytes\n"
+"\n"
+"Return the layout fork() would share, as a block of native integers\n"
+"which holds no pointers.  Copied into shared memory, such as a\n"
+"multiprocessing.shared_memory.SharedMemory or an mmap of a memfd, it\n"
+"can be searched by Coverings.attach() in other processes on the same\n"
+"machine, without being copied or rebuilt.  Must be called as for\n"
+"fork().\n";
+
+/* .share() */
+static PyObject *
+Coverings_share(Coverings *self)
+{
+    PyObject *capsule;
+    const CellsLayout *layout;
+
+    if (!(capsule = Coverings_shared_layout(self, "share")))
+        return NULL;
+    layout = (CellsLayout *)PyCapsule_GetPointer(capsule, LAYOUT_NAME);
+    if (!layout)
+        return NULL;
+    return PyBytes_FromStringAndSize((const char *)layout->block,
+                                     layout->words * sizeof(int));
+}
+
+static char Coverings_attach__doc__[] =
+"Coverings.attach(buffer, rows=None, prefix=None) -> Coverings object\n"
+"\n"
+"Return a fork searching the layout written by share() in buffer, which\n"
+"is used where it lies and must stay unchanged while the fork is alive.\n"
+"Only the fork's own search state is allocated, so attaching costs time\n"
+"in proportion to the matrix only to check the layout and copy its\n"
+"starting state, never to rebuild it.\n"
+"\n"
+"rows is the sequence of rows the layout was made from; without it,\n"
+"coverings are tuples of row indices instead.  prefix is as for\n"
+"Coverings().\n";
+
+/* Coverings.attach() */
+static PyObject *
+Coverings_attach(PyObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"buffer", "rows", "prefix", NULL};
+    PyObject *buffer;
+    PyObject *rows = Py_None;
+    PyObject *prefix = Py_None;
+    PyObject *capsule;
+    PyObject *fork;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO:attach", kwlist,
+                                     &buffer, &rows, &prefix))
+        return NULL;
+    if (!(capsule = attach_layout(buffer, rows)))
+        return NULL;
+    fork = Coverings_new_fork((PyTypeObject *)type, capsule, prefix);
+    Py_DECREF(capsule);
+    return fork;
+}
+
+/* ------------------------------------------------------------------------ *
+ * ZDD class                                                                *
+ * ------------------------------------------------------------------------ */
+
+/* The coverings, as a zero-suppressed decision diagram built by Knuth's DXZ:
+ * DLX which remembers the diagram for each subproblem it has solved.  Each
+ * node branches on one row; its hi child is taken with that row, its lo
+ * child without.  Rows need not appear in the same order on every path, but
+ * every covering is exactly one path to ZDD_TOP. */
+#define ZDD_BOTTOM 0
+#define ZDD_TOP 1
+
+typedef struct {
+    PyObject_HEAD
+
+    /* Nodes.  The terminals are nodes 0 and 1, and every node is created
+     * after its children. */
+    int *var;
+    int *lo;
+    int *hi;
+    int nodeCount;
+    int nodeCapacity;
+    int root;
+
+    /* The row objects, indexed by input row. */
+    PyObject *rows;
+
+    /* Number of paths to ZDD_TOP from each node, computed on demand. */
+    PyObject **counts;
+} ZDD;
+
+#if PY_MAJOR_VERSION >= 3
+/* The types live in the state of each module object, so that every
+ * interpreter has its own. */
+typedef struct {
+    PyTypeObject *CoveringsType;
+    PyTypeObject *ZDDType;
+    PyTypeObject *ZDDIterType;
+} ModuleState;
+
+static struct PyModuleDef exactcover_module;
+
+/* Return the state of the module which defined the type of obj. */
+static ModuleState *
+module_state(PyObject *obj)
+{
+    PyObject *module = PyType_GetModuleByDef(Py_TYPE(obj),
+                                             &exactcover_module);
+    return module ? (ModuleState *)PyModule_GetState(module) : NULL;
+}
+
+#define ZDD_TYPE(obj) (module_state((PyObject *)(obj))->ZDDType)
+#define ZDDITER_TYPE(obj) (module_state((PyObject *)(obj))->ZDDIterType)
+#else
+static PyTypeObject ZDD_Type;
+static PyTypeObject ZDDIter_Type;
+
+#define ZDD_TYPE(obj) (&ZDD_Type)
+#define ZDDITER_TYPE(obj) (&ZDDIter_Type)
+#endif
+
+static char ZDD__doc__[] =
+"Every exact cover of a matrix, as a zero-suppressed decision diagram.\n"
+"\n"
+"Returned by Coverings.zdd().  Iterating over it produces the coverings,\n"
+"in the same order as the Coverings object would have.\n";
+
+/* Add a node, returning its number or -1 on failure. */
+static int
+zdd_node(ZDD *zdd, int var, int lo, int hi)
+{
+    if (zdd->nodeCount == zdd->nodeCapacity) {
+        int capacity = 2 * zdd->nodeCapacity;
+        int *v = zdd->var;
+        int *l = zdd->lo;
+        int *h = zdd->hi;
+
+        if (capacity < 0 || !PyMem_Resize(v, int, capacity) ||
+            (zdd->var = v, !PyMem_Resize(l, int, capacity)) ||
+            (zdd->lo = l, !PyMem_Resize(h, int, capacity))) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        zdd->hi = h;
+        zdd->nodeCapacity = capacity;
+    }
+
+    zdd->var[zdd->nodeCount] = var;
+    zdd->lo[zdd->nodeCount] = lo;
+    zdd->hi[zdd->nodeCount] = hi;
+    return zdd->nodeCount++;
+}
+
+/* Free zdd->counts and any counts in it, so they are filled in afresh. */
+static void
+ZDD_free_counts(ZDD *zdd)
+{
+    int i;
+
+    if (!zdd->counts)
+        return;
+    for (i = 0; i < zdd->nodeCount; i++)
+        Py_XDECREF(zdd->counts[i]);
+    PyMem_Del(zdd->counts);
+    zdd->counts = NULL;
+}
+
+/* Fill in zdd->counts.  Returns -1 on failure, leaving it NULL. */
+static int
+ZDD_count_paths(ZDD *zdd)
+{
+    int i;
+
+    if (zdd->counts)
+        return 0;
+    zdd->counts = PyMem_New(PyObject *, zdd->nodeCount);
+    if (!zdd->counts) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    memset(zdd->counts, 0, zdd->nodeCount * sizeof(PyObject *));
+
+    zdd->counts[ZDD_BOTTOM] = PyInt_FromLong(0);
+    zdd->counts[ZDD_TOP] = PyInt_FromLong(1);
+    if (!zdd->counts[ZDD_BOTTOM] || !zdd->counts[ZDD_TOP])
+        goto error;
+    for (i = ZDD_TOP + 1; i < zdd->nodeCount; i++) {
+        zdd->counts[i] = PyNumber_Add(zdd->counts[zdd->lo[i]],
+                                      zdd->counts[zdd->hi[i]]);
+        if (!zdd->counts[i])
+            goto error;
+    }
+    return 0;
+
+error:
+    ZDD_free_counts(zdd);
+    return -1;
+}
+
+static char ZDD_count__doc__[] =
+"count() -> int\n"
+"\n"
+"Return the number of coverings.\n";
+
+/* .count() */
+static PyObject *
+ZDD_count(ZDD *self)
+{
+    if (ZDD_count_paths(self) < 0)
+        return NULL;
+    Py_INCREF(self->counts[self->root]);
+    return self->counts[self->root];
+}
+
+static char ZDD_sample__doc__[] =
+"sample(random=None) -> tuple\n"
+"\n"
+"Return a covering chosen uniformly at random.  random is an object with\n"
+"a randrange() method, such as a random.Random instance; the random\n"
+"module is used by default.\n";
+
+/* .sample() */
+static PyObject *
+ZDD_sample(ZDD *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"random", NULL};
+    PyObject *random = Py_None;
+    PyObject *module = NULL;
+    PyObject *k = NULL;
+    PyObject *list = NULL;
+    PyObject *result = NULL;
+    int n;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O:sample", kwlist,
+                                     &random))
+        return NULL;
+    if (ZDD_count_paths(self) < 0)
+        return NULL;
+    if (self->root == ZDD_BOTTOM) {
+        PyErr_SetString(PyExc_ValueError, "there are no coverings");
+        return NULL;
+    }
+
+    if (random == Py_None) {
+        if (!(module = PyImport_ImportModule("random")))
+            return NULL;
+        random = module;
+    }
+    k = PyObject_CallMethod(random, "randrange", "O",
+                            self->counts[self->root]);
+    if (!k || !(list = PyList_New(0)))
+        goto done;
+
+    /* k numbers the paths below n; walk down to the k-th. */
+    for (n = self->root; n != ZDD_TOP; ) {
+        PyObject *hi = self->counts[self->hi[n]];
+        int cmp = PyObject_RichCompareBool(k, hi, Py_LT);
+        if (cmp < 0) {
+            goto done;
+        } else if (cmp) {
+            if (PyList_Append(list,
+                              PyTuple_GET_ITEM(self->rows, self->var[n])) < 0)
+                goto done;
+            n = self->hi[n];
+        } else {
+            PyObject *rest = PyNumber_Subtract(k, hi);
+            if (!rest)
+                goto done;
+            Py_DECREF(k);
+            k = rest;
+            n = self->lo[n];
+        }
+    }
+    result = PyList_AsTuple(list);
+
+done:
+    Py_XDECREF(module);
+    Py_XDECREF(k);
+    Py_XDECREF(list);
+    return result;
+}
+
+/* .tp_traverse */
+static int
+ZDD_traverse(ZDD *self, visitproc visit, void *arg)
+{
+    VISIT_TYPE(self);
+    Py_VISIT(self->rows);
+    return 0;
+}
+
+/* .tp_clear */
+static int
+ZDD_clear(ZDD *self)
+{
+    Py_CLEAR(self->rows);
+    return 0;
+}
+
+/* .tp_dealloc */
+static void
+ZDD_dealloc(ZDD *self)
+{
+    PyTypeObject *type = Py_TYPE((PyObject *)self);
+
+    PyObject_GC_UnTrack(self);
+    ZDD_clear(self);
+    ZDD_free_counts(self);
+    PyMem_Del(self->var);
+    PyMem_Del(self->lo);
+    PyMem_Del(self->hi);
+    PyObject_GC_Del(self);
+    RELEASE_TYPE(type);
+}
+
+/* Create an empty diagram over rows, holding just the terminals.  owner is an
+ * object of this module, whose ZDD type is used. */
+static ZDD *
+ZDD_new(PyObject *owner, PyObject *rows)
+{
+    ZDD *self = PyObject_GC_New(ZDD, ZDD_TYPE(owner));
+    if (!self)
+        return NULL;
+    self->nodeCount = 2;
+    self->nodeCapacity = 1024;
+    self->root = ZDD_BOTTOM;
+    self->counts = NULL;
+    Py_INCREF(rows);
+    self->rows = rows;
+    self->var = PyMem_New(int, self->nodeCapacity);
+    self->lo = PyMem_New(int, self->nodeCapacity);
+    self->hi = PyMem_New(int, self->nodeCapacity);
+    PyObject_GC_Track(self);
+    if (!self->var || !self->lo || !self->hi) {
+        Py_DECREF(self);
+        return (ZDD *)PyErr_NoMemory();
+    }
+    self->var[ZDD_BOTTOM] = self->var[ZDD_TOP] = -1;
+    self->lo[ZDD_BOTTOM] = self->lo[ZDD_TOP] = ZDD_BOTTOM;
+    self->hi[ZDD_BOTTOM] = self->hi[ZDD_TOP] = ZDD_BOTTOM;
+    return self;
+}
+
+/* Iterator over the paths of a ZDD. */
+typedef struct {
+    PyObject_HEAD
+
+    ZDD *zdd;
+
+    /* The current path: each node passed, and whether its lo child was
+     * taken. */
+    int *node;
+    char *lo;
+    int depth;
+
+    /* Non-zero until the first path has been found. */
+    int first;
+} ZDDIter;
+
+/* .__iter__() */
+static PyObject *
+ZDD_iter(ZDD *self)
+{
+    ZDDIter *it = PyObject_GC_New(ZDDIter, ZDDITER_TYPE(self));
+    if (!it)
+        return NULL;
+    Py_INCREF(self);
+    it->zdd = self;
+    it->depth = 0;
+    it->first = 1;
+    it->node = PyMem_New(int, self->nodeCount);
+    it->lo = PyMem_New(char, self->nodeCount);
+    PyObject_GC_Track(it);
+    if (!it->node || !it->lo) {
+        Py_DECREF(it);
+        return PyErr_NoMemory();
+    }
+    return (PyObject *)it;
+}
+
+/* Follow hi children from n, returning the terminal reached. */
+static int
+ZDDIter_descend(ZDDIter *it, int n)
+{
+    while (n > ZDD_TOP) {
+        it->node[it->depth] = n;
+        it->lo[it->depth] = 0;
+        it->depth++;
+        n = it->zdd->hi[n];
+    }
+    return n;
+}
+
+/* .next() */
+static PyObject *
+ZDDIter_next(ZDDIter *it)
+{
+    ZDD *zdd = it->zdd;
+    PyObject *tuple;
+    int size = 0;
+    int i;
+
+    if (it->first) {
+        it->first = 0;
+        if (ZDDIter_descend(it, zdd->root) == ZDD_TOP)
+            goto found;
+    }
+
+    for (;;) {
+        /* Back up to the deepest node whose lo child is unexplored. */
+        while (it->depth > 0 && it->lo[it->depth - 1])
+            it->depth--;
+        if (it->depth == 0)
+            return NULL;
+        it->lo[it->depth - 1] = 1;
+        if (ZDDIter_descend(it, zdd->lo[it->node[it->depth - 1]]) ==
+            ZDD_TOP)
+            goto found;
+    }
+
+found:
+    for (i = 0; i < it->depth; i++)
+        size += !it->lo[i];
+    if (!(tuple = PyTuple_New(size)))
+        return NULL;
+    size = 0;
+    for (i = 0; i < it->depth; i++) {
+        PyObject *object;
+        if (it->lo[i])
+            continue;
+        object = PyTuple_GET_ITEM(zdd->rows, zdd->var[it->node[i]]);
+        Py_INCREF(object);
+        PyTuple_SET_ITEM(tuple, size, object);
+        size++;
+    }
+    return tuple;
+}
+
+/* .tp_traverse */
+static int
+ZDDIter_traverse(ZDDIter *it, visitproc visit, void *arg)
+{
+    VISIT_TYPE(it);
+    Py_VISIT(it->zdd);
+    return 0;
+}
+
+/* .tp_dealloc */
+static void
+ZDDIter_dealloc(ZDDIter *it)
+{
+    PyTypeObject *type = Py_TYPE((PyObject *)it);
+
+    PyObject_GC_UnTrack(it);
+    Py_XDECREF(it->zdd);
+    PyMem_Del(it->node);
+    PyMem_Del(it->lo);
+    PyObject_GC_Del(it);
+    RELEASE_TYPE(type);
+}
+
+/* Build the diagram below the current state of the matrix.  Returns the root,
+ * or -1 on failure. */
+static int
+Coverings_dxz(Coverings *self, ZDD *zdd, Memo *memo)
+{
+    Header *column = smallest_column(self->corner);
+    MemoEntry *entry;
+    Element *row;
+    int result = ZDD_BOTTOM;
+
+    if (column == NULL) {
+        return ZDD_TOP;
+    } else if (column->count == 0) {
+        return ZDD_BOTTOM;
+    }
+
+    memo_signature(memo, self->corner, self->secondary);
+    if ((entry = memo_lookup(memo)))
+        return (int)entry->value;
+
+    /* Chain the rows from the bottom up, so the first row is the root. */
+    for (row = column->e.up; row != &column->e; row = row->up) {
+        int hi;
+
+        unlink_row(row);
+        hi = Coverings_dxz(self, zdd, memo);
+        link_row(row);
+        if (hi < 0)
+            return -1;
+        if (hi != ZDD_BOTTOM &&
+            (result = zdd_node(zdd, row->row, result, hi)) < 0)
+            return -1;
+    }
+
+    memo_signature(memo, self->corner, self->secondary);
+    if (!memo_insert(memo, result, NULL)) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    return result;
+}
+
+static char Coverings_zdd__doc__[] =
+"zdd() -> ZDD object\n"
+"\n"
+"Build a decision diagram of every covering, without enumerating them.\n"
+"Subproblems with the same uncovered elements are solved once, so this\n"
+"can be exponentially faster than iterating.  The result supports\n"
+"count(), sample() and iteration.  Must be called before iteration\n"
+"starts, and does not support colors or bounds.\n";
+
+/* .zdd() */
+static PyObject *
+Coverings_zdd(Coverings *self)
+{
+    PyObject *rows;
+    ZDD *zdd;
+    Memo memo;
+    int root;
+    int i;
+
+    if (!Coverings_has_matrix(self, "zdd"))
+        return NULL;
+    if (!self->first) {
+        PyErr_SetString(PyExc_ValueError,
+                        "zdd() must be called before iteration");
+        return NULL;
+    }
+    if (self->colored || self->multiplicity || self->group || self->copies) {
+        PyErr_SetString(PyExc_ValueError,
+                        "zdd() does not support colors, bounds, symmetries "
+                        "or merged duplicates");
+        return NULL;
+    }
+
+    if (!(rows = PyTuple_New(self->rowCount)))
+        return NULL;
+    for (i = 0; i < self->rowCount; i++) {
+        PyObject *object = self->rows[i] ? self->rows[i]->object : Py_None;
+        Py_INCREF(object);
+        PyTuple_SET_ITEM(rows, i, object);
+    }
+    zdd = ZDD_new((PyObject *)self, rows);
+    Py_DECREF(rows);
+    if (!zdd)
+        return NULL;
+
+    if (memo_init(&memo, self->itemCount, 0) < 0) {
+        Py_DECREF(zdd);
+        return PyErr_NoMemory();
+    }
+    root = Coverings_dxz(self, zdd, &memo);
+    memo_free(&memo);
+
+    /* The prefix is on every path. */
+    for (i = self->base - 1; i >= 0 && root > ZDD_BOTTOM; i--)
+        root = zdd_node(zdd, self->solution[i]->row, ZDD_BOTTOM, root);
+
+    if (root < 0) {
+        Py_DECREF(zdd);
+        return NULL;
+    }
+    zdd->root = root;
+    return (PyObject *)zdd;
+}
+
+LOCKED_NOARGS(ZDD_count, ZDD)
+LOCKED_KWARGS(ZDD_sample, ZDD, PyObject *)
+LOCKED_NOARGS(ZDDIter_next, ZDDIter)
+
+static PyMethodDef ZDD_methods[] = {
+    { "count", (PyCFunction)ZDD_count_locked, METH_NOARGS,
+      ZDD_count__doc__ },
+    { "sample", (PyCFunction)ZDD_sample_locked, METH_VARARGS | METH_KEYWORDS,
+      ZDD_sample__doc__ },
+    { NULL }
+};
+
+#if PY_MAJOR_VERSION >= 3
+static PyType_Slot ZDD_slots[] = {
+    { Py_tp_dealloc, (void *)ZDD_dealloc },
+    { Py_tp_hash, (void *)PyObject_HashNotImplemented },
+    { Py_tp_doc, (void *)ZDD__doc__ },
+    { Py_tp_traverse, (void *)ZDD_traverse },
+    { Py_tp_clear, (void *)ZDD_clear },
+    { Py_tp_iter, (void *)ZDD_iter },
+    { Py_tp_methods, (void *)ZDD_methods },
+    { 0, NULL }
+};
+
+static PyType_Spec ZDD_spec = {
+    "exactcover.ZDD",
+    sizeof(ZDD),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_IMMUTABLETYPE |
+        Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    ZDD_slots
+};
+
+static PyType_Slot ZDDIter_slots[] = {
+    { Py_tp_dealloc, (void *)ZDDIter_dealloc },
+    { Py_tp_hash, (void *)PyObject_HashNotImplemented },
+    { Py_tp_traverse, (void *)ZDDIter_traverse },
+    { Py_tp_iter, (void *)PyObject_SelfIter },
+    { Py_tp_iternext, (void *)ZDDIter_next_locked },
+    { 0, NULL }
+};
+
+static PyType_Spec ZDDIter_spec = {
+    "exactcover.ZDDIterator",
+    sizeof(ZDDIter),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_IMMUTABLETYPE |
+        Py_TPFLAGS_DISALLOW_INSTANTIATION,
+    ZDDIter_slots
+};
+#else
+static PyTypeObject ZDD_Type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                       /* ob_size */
+    "exactcover.ZDD",                        /* tp_name */
+    sizeof(ZDD),                             /* tp_basicsize */
+    0,                                       /* tp_itemsize */
+    (destructor)ZDD_dealloc,                 /* tp_dealloc */
+    0,                                       /* tp_print */
+    0,                                       /* tp_getattr */
+    0,                                       /* tp_setattr */
+    0,                                       /* tp_compare */
+    0,                                       /* tp_repr */
+    0,                                       /* tp_as_number */
+    0,                                       /* tp_as_sequence */
+    0,                                       /* tp_as_mapping */
+    PyObject_HashNotImplemented,             /* tp_hash */
+    0,                                       /* tp_call */
+    0,                                       /* tp_str */
+    0,                                       /* tp_getattro */
+    0,                                       /* tp_setattro */
+    0,                                       /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC, /* tp_flags */
+    ZDD__doc__,                              /* tp_doc */
+    (traverseproc)ZDD_traverse,              /* tp_traverse */
+    (inquiry)ZDD_clear,                      /* tp_clear */
+    0,                                       /* tp_richcompare */
+    0,                                       /* tp_weaklistoffset */
+    (getiterfunc)ZDD_iter,                   /* tp_iter */
+    0,                                       /* tp_iternext */
+    ZDD_methods,                             /* tp_methods */
+};
+
+static PyTypeObject ZDDIter_Type = {
+    PyObject_HEAD_INIT(NULL)
+    0,                                       /* ob_size */
+    "exactcover.ZDDIterator",                /* tp_name */
+    sizeof(ZDDIter),                         /* tp_basicsize */
+    0,                                       /* tp_itemsize */
+    (destructor)ZDDIter_dealloc,             /* tp_dealloc */
+    0,                                       /* tp_print */
+    0,                                       /* tp_getattr */
+    0,                                       /* tp_setattr */
+    0,                                       /* tp_compare */
+    0,                                       /* tp_repr */
+    0,                                       /* tp_as_number */
+    0,                                       /* tp_as_sequence */
+    0,                                       /* tp_as_mapping */
+    PyObject_HashNotImplemented,             /* tp_hash */
+    0,                                       /* tp_call */
+    0,                                       /* tp_str */
+    0,                                       /* tp_getattro */
+    0,                                       /* tp_setattro */
+    0,                                       /* tp_as_buffer */
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC, /* tp_flags */
+    0,                                       /* tp_doc */
+    (traverseproc)ZDDIter_traverse,          /* tp_traverse */
+    0,                                       /* tp_clear */
+    0,                                       /* tp_richcompare */
+    0,                                       /* tp_weaklistoffset */
+    PyObject_SelfIter,                       /* tp_iter */
+    (iternextfunc)ZDDIter_next_locked,       /* tp_iternext */
+};
+#endif
+
+/* ------------------------------------------------------------------------ *
+ * Counting                                                                 *
+ * ------------------------------------------------------------------------ */
+
+typedef struct {
+    Memo memo;
+
+    /* Scratch space for finding components: the columns in the order they
+     * were reached, and the visit each column and row was last reached in. */
+    Header **queue;
+    int *seen;
+    int *rowSeen;
+    int visit;
+
+    /* Looking for components costs a pass over the matrix, so after each
+     * fruitless look, wait twice as long before the next, up to a limit. */
+    int wait;
+    int interval;
+} Counter;
+
+#define COMPONENT_INTERVAL 64
+
+static void
+detach_column(Header *column)
+{
+    column->e.left->right = column->e.right;
+    column->e.right->left = column->e.left;
+}
+
+static void
+attach_column(Header *column)
+{
+    column->e.left->right = &column->e;
+    column->e.right->left = &column->e;
+}
+
+/* Group the linked columns into components which no row spans, starting a
+ * component from each primary column not yet reached.  The columns end up in
+ * counter->queue, a component at a time, and starts receives the queue
+ * position of each component (and, after the last, the end of the queue).
+ * Secondary columns reached from no primary column are left out.  Returns
+ * the number of components. */
+static int
+Coverings_components(Coverings *self, Counter *counter, int *starts)
+{
+    Header **queue = counter->queue;
+    int visit = ++counter->visit;
+    int components = 0;
+    int head = 0;
+    int tail = 0;
+    Element *e;
+
+    for (e = self->corner->e.right; e != &self->corner->e; e = e->right) {
+        Header *column = (Header *)e;
+        if (counter->seen[column->index] == visit)
+            continue;
+        starts[components++] = tail;
+        counter->seen[column->index] = visit;
+        queue[tail++] = column;
+
+        while (head < tail) {
+            Element *row;
+            column = queue[head++];
+            for (row = column->e.down; row != &column->e; row = row->down) {
+                Element *other;
+                if (counter->rowSeen[row->row] == visit)
+                    continue;
+                counter->rowSeen[row->row] = visit;
+                for (other = row->right; other != row; other = other->right) {
+                    if (counter->seen[other->column->index] != visit) {
+                        counter->seen[other->column->index] = visit;
+                        queue[tail++] = other->column;
+                    }
+                }
+            }
+        }
+    }
+    starts[components] = tail;
+    return components;
+}
+
+static PyObject *Coverings_count_below(Coverings *self, Counter *counter);
+
+/* Count the coverings of each component separately, and multiply.  Returns
+ * a new reference, or NULL on failure. */
+static PyObject *
+Coverings_count_components(Coverings *self, Counter *counter,
+                           int components, int *starts)
+{
+    int size = starts[components];
+    Header **order = PyMem_New(Header *, size);
+    PyObject *product = NULL;
+    int i, j;
+
+    if (!order)
+        return PyErr_NoMemory();
+    memcpy(order, counter->queue, size * sizeof(Header *));
+    if (!(product = PyInt_FromLong(1)))
+        goto done;
+
+    for (i = 0; i < components; i++) {
+        PyObject *count, *result;
+        int empty;
+
+        /* Leave only this component linked. */
+        for (j = 0; j < size; j++) {
+            if (j < starts[i] || j >= starts[i + 1])
+                detach_column(order[j]);
+        }
+        count = Coverings_count_below(self, counter);
+        for (j = size - 1; j >= 0; j--) {
+            if (j < starts[i] || j >= starts[i + 1])
+                attach_column(order[j]);
+        }
+
+        if (!count) {
+            Py_CLEAR(product);
+            goto done;
+        }
+        result = PyNumber_Multiply(product, count);
+        empty = PyObject_Not(count);
+        Py_DECREF(count);
+        Py_DECREF(product);
+        if (!(product = result) || empty)
+            break;
+    }
+
+done:
+    PyMem_Del(order);
+    return product;
+}
+
+/* Count the coverings below the current state of the matrix.  Returns a new
+ * reference, or NULL on failure. */
+static PyObject *
+Coverings_count_below(Coverings *self, Counter *counter)
+{
+    Memo *memo = &counter->memo;
+    Header *column = smallest_column(self->corner);
+    MemoEntry *entry;
+    Element *row;
+    PyObject *total;
+    int *starts;
+    int components;
+
+    if (column == NULL) {
+        return PyInt_FromLong(1);
+    } else if (column->count == 0) {
+        return PyInt_FromLong(0);
+    }
+
+    memo_signature(memo, self->corner, self->secondary);
+    if ((entry = memo_lookup(memo))) {
+        Py_INCREF(entry->object);
+        return entry->object;
+    }
+
+    /* Independent parts of the matrix are counted on their own, so their
+     * subproblems are shared between all the ways of covering the rest. */
+    if (--counter->wait <= 0) {
+        if (!(starts = PyMem_New(int, self->itemCount + 1)))
+            return PyErr_NoMemory();
+        components = Coverings_components(self, counter, starts);
+        if (components > 1) {
+            counter->wait = counter->interval = 1;
+            total = Coverings_count_components(self, counter,
+                                               components, starts);
+            PyMem_Del(starts);
+            if (!total)
+                return NULL;
+            goto found;
+        }
+        PyMem_Del(starts);
+        if (counter->interval < COMPONENT_INTERVAL)
+            counter->interval *= 2;
+        counter->wait = counter->interval;
+    }
+
+    if (!(total = PyInt_FromLong(0)))
+        return NULL;
+    for (row = column->e.down; row != &column->e; row = row->down) {
+        PyObject *count, *sum;
+
+        unlink_row(row);
+        count = Coverings_count_below(self, counter);
+        link_row(row);
+        if (self->copies)
+            count = times(count, Coverings_copies(self, row->row));
+        if (!count) {
+            Py_DECREF(total);
+            return NULL;
+        }
+        sum = PyNumber_Add(total, count);
+        Py_DECREF(count);
+        Py_DECREF(total);
+        if (!(total = sum))
+            return NULL;
+    }
+
+found:
+    memo_signature(memo, self->corner, self->secondary);
+    if (!memo_insert(memo, 0, total)) {
+        Py_DECREF(total);
+        return PyErr_NoMemory();
+    }
+    return total;
+}
+
+static char Coverings_count__doc__[] =
+"count(cache=1048576) -> int\n"
+"\n"
+"Return the number of coverings, without enumerating them.  The count\n"
+"for each set of uncovered elements is remembered, in a table holding at\n"
+"most cache entries; the least recently used is forgotten first.  When\n"
+"the uncovered elements fall into groups that no row spans, each group\n"
+"is counted separately.  Must be called before iteration starts, and does\n"
+"not support colors or bounds.\n";
+
+/* .count() */
+static PyObject *
+Coverings_count(Coverings *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"cache", NULL};
+    long cache = 1L << 20;
+    PyObject *result = NULL;
+    Counter counter;
+    int i;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|l:count", kwlist,
+                                     &cache))
+        return NULL;
+    if (cache < 1) {
+        PyErr_SetString(PyExc_ValueError, "cache must be positive");
+        return NULL;
+    }
+    if (!Coverings_has_matrix(self, "count"))
+        return NULL;
+    if (!self->first) {
+        PyErr_SetString(PyExc_ValueError,
+                        "count() must be called before iteration");
+        return NULL;
+    }
+    if (self->colored || self->multiplicity || self->group) {
+        PyErr_SetString(PyExc_ValueError,
+                        "count() does not support colors, bounds or "
+                        "symmetries");
+        return NULL;
+    }
+
+    counter.queue = PyMem_New(Header *, self->itemCount);
+    counter.seen = PyMem_New(int, self->itemCount);
+    counter.rowSeen = PyMem_New(int, self->rowCount);
+    counter.visit = 0;
+    counter.wait = counter.interval = 1;
+    if (!counter.queue || !counter.seen || !counter.rowSeen) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    memset(counter.seen, 0, self->itemCount * sizeof(int));
+    memset(counter.rowSeen, 0, self->rowCount * sizeof(int));
+
+    if (memo_init(&counter.memo, self->itemCount,
+                  (unsigned long)cache) < 0) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    result = Coverings_count_below(self, &counter);
+    memo_free(&counter.memo);
+    for (i = 0; self->copies && i < self->solutionSize; i++)
+        result = times(result, Coverings_copies(self, self->solution[i]->row));
+
+done:
+    PyMem_Del(counter.queue);
+    PyMem_Del(counter.seen);
+    PyMem_Del(counter.rowSeen);
+    return result;
+}
+
+/* ------------------------------------------------------------------------ *
+ * Reduction                                                                *
+ * ------------------------------------------------------------------------ */
+
+/* Simplifications in the style of Knuth's DLX-PRE, made before the search
+ * starts.  They only ever drop rows which are in no covering, and push rows
+ * which are in every covering onto the base of the solution stack, so the
+ * coverings found are unchanged. */
+
+/* Non-zero if row has an element in a column whose index is marked with
+ * visit in seen. */
+static int
+row_touches(Element *row, int *seen, int visit)
+{
+    Element *e = row;
+    do {
+        if (seen[e->column->index] == visit)
+            return 1;
+        e = e->right;
+    } while (e != row);
+    return 0;
+}
+
+/* Choose the rows of primary columns with only one row left.  Returns the
+ * number chosen, or -1 if some column has no rows, so nothing can cover
+ * it. */
+static int
+Coverings_force(Coverings *self)
+{
+    int forced = 0;
+    Header *column = (Header *)self->corner->e.right;
+
+    while (column != self->corner) {
+        if (column->count == 0)
+            return -1;
+        if (column->count == 1 && Coverings_choose(self, column->e.down)) {
+            forced++;
+            column = (Header *)self->corner->e.right;
+            continue;
+        }
+        column = (Header *)column->e.right;
+    }
+    return forced;
+}
+
+/* When every row of a primary column also has some other column, rows of
+ * that other column without the first can never be used: drop them.  The
+ * other column is then left with the same rows as the first, which covers
+ * it whenever it is covered itself, so if it is primary it is marked in
+ * merged, to be made secondary by Coverings_merge_columns().  Returns the
+ * number of columns marked, and stores the number of rows dropped in
+ * *dropped. */
+static int
+Coverings_drop_dominated(Coverings *self, int *hits, char *merged,
+                         int *dropped)
+{
+    Header *column = (Header *)self->corner->e.right;
+    int count = 0;
+
+    *dropped = 0;
+    for (; column != self->corner; column = (Header *)column->e.right) {
+        Element *row, *e;
+
+        if (merged[column->index] || column->count == 0)
+            continue;
+
+        /* Count, for each column, the rows of this one it appears in. */
+        for (row = column->e.down; row != &column->e; row = row->down) {
+            for (e = row->right; e != row; e = e->right)
+                hits[e->column->index] = 0;
+        }
+        for (row = column->e.down; row != &column->e; row = row->down) {
+            for (e = row->right; e != row; e = e->right)
+                hits[e->column->index]++;
+        }
+
+        for (row = column->e.down; row != &column->e; row = row->down) {
+            for (e = row->right; e != row; e = e->right) {
+                Header *other = e->column;
+                Element *r, *next;
+
+                if (hits[other->index] != column->count)
+                    continue;
+                hits[other->index] = 0;
+
+                for (r = other->e.down; r != &other->e; r = next) {
+                    Element *f = r;
+                    next = r->down;
+                    do {
+                        f = f->right;
+                    } while (f != r && f->column != column);
+                    if (f == r) {
+                        remove_row(r);
+                        (*dropped)++;
+                    }
+                }
+                if (other->bound > 0 && !merged[other->index]) {
+                    merged[other->index] = 1;
+                    count++;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+/* Move the columns marked in merged to the secondary chain.  A column taken
+ * out of the matrix remembers its neighbors to be put back between them, so
+ * the headers of the columns the stack covers are first put back, in the
+ * reverse order, and taken out again afterwards.  Only the header chains are
+ * touched: rows hidden by the stack stay hidden. */
+static void
+Coverings_merge_columns(Coverings *self, char *merged)
+{
+    int i;
+
+    for (i = self->solutionSize - 1; i >= 0; i--) {
+        Element *row = self->solution[i];
+        Element *e = row->left;
+        do {
+            attach_column(e->column);
+            e = e->left;
+        } while (e != row->left);
+    }
+    for (i = 0; i < self->itemCount; i++) {
+        Header *column = self->items[i];
+        if (!merged[i])
+            continue;
+        detach_column(column);
+        column->e.right = &self->secondary->e;
+        column->e.left = self->secondary->e.left;
+        attach_column(column);
+        column->bound = -1;
+    }
+    for (i = 0; i < self->solutionSize; i++) {
+        Element *row = self->solution[i];
+        Element *e = row;
+        do {
+            detach_column(e->column);
+            e = e->right;
+        } while (e != row);
+    }
+}
+
+/* Drop rows which would leave some primary column without a usable row.
+ * Returns the number dropped. */
+static int
+Coverings_drop_blocking(Coverings *self, int *seen, int *visit)
+{
+    int dropped = 0;
+    int r;
+
+    for (r = 0; r < self->rowCount; r++) {
+        Element *row = self->rows[r];
+        Element *e;
+        Header *column;
+
+        if (!row || !row_available(row))
+            continue;
+
+        ++*visit;
+        e = row;
+        do {
+            seen[e->column->index] = *visit;
+            e = e->right;
+        } while (e != row);
+
+        column = (Header *)self->corner->e.right;
+        for (; column != self->corner; column = (Header *)column->e.right) {
+            Element *other;
+            if (seen[column->index] == *visit)
+                continue;
+            for (other = column->e.down; other != &column->e;
+                 other = other->down) {
+                if (!row_touches(other, seen, *visit))
+                    break;
+            }
+            if (other == &column->e) {
+                remove_row(row);
+                dropped++;
+                break;
+            }
+        }
+    }
+    return dropped;
+}
+
+static char Coverings_reduce__doc__[] =
+"reduce() -> dict\n"
+"\n"
+"Simplify the matrix before searching.  Rows that would leave some\n"
+"primary element impossible to cover are removed, elements always\n"
+"covered together are merged, and rows which are the only way left to\n"
+"cover an element are chosen up front, like a prefix.  This is repeated\n"
+"until nothing changes.  The coverings found are not affected.\n"
+"\n"
+"Returns a dict with the number of 'rows' removed, 'items' merged and\n"
+"rows 'forced'.  Must be called before iteration starts, and does not\n"
+"support colors or bounds.\n";
+
+/* .reduce() */
+static PyObject *
+Coverings_reduce(Coverings *self)
+{
+    int *seen = NULL;
+    int *hits = NULL;
+    char *merged = NULL;
+    int visit = 0;
+    int removed = 0;
+    int items = 0;
+    int forced = 0;
+    PyObject *result = NULL;
+
+    if (!Coverings_has_matrix(self, "reduce"))
+        return NULL;
+    if (!self->first) {
+        PyErr_SetString(PyExc_ValueError,
+                        "reduce() must be called before iteration");
+        return NULL;
+    }
+    if (self->colored || self->multiplicity) {
+        PyErr_SetString(PyExc_ValueError,
+                        "reduce() does not support colors or bounds");
+        return NULL;
+    }
+
+    /* Forks already made keep the layout of the rows they were made from. */
+    Py_CLEAR(self->layout);
+
+    seen = PyMem_New(int, self->itemCount + 1);
+    hits = PyMem_New(int, self->itemCount + 1);
+    merged = PyMem_New(char, self->itemCount + 1);
+    if (!seen || !hits || !merged) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    memset(seen, 0, (self->itemCount + 1) * sizeof(int));
+    memset(merged, 0, self->itemCount + 1);
+
+    for (;;) {
+        int n, dropped;
+
+        if ((n = Coverings_force(self)) < 0)
+            break;
+        forced += n;
+
+        items += Coverings_drop_dominated(self, hits, merged, &dropped);
+        n = dropped + Coverings_drop_blocking(self, seen, &visit);
+        removed += n;
+        if (n == 0)
+            break;
+    }
+    if (items > 0)
+        Coverings_merge_columns(self, merged);
+    self->base = self->solutionSize;
+    self->reduced = 1;
+
+    result = Py_BuildValue("{s:i,s:i,s:i}", "rows", removed,
+                           "items", items, "forced", forced);
+
+done:
+    PyMem_Del(seen);
+    PyMem_Del(hits);
+    PyMem_Del(merged);
+    return result;
+}
+
+/* ------------------------------------------------------------------------ *
+ * Symmetry                                                                 *
+ * ------------------------------------------------------------------------ */
+
+/* Given a group of permutations of the items which map the rows onto each
+ * other, only one covering from each orbit is produced: the one whose rows,
+ * sorted by rank, are lexicographically least.  Every covering takes exactly
+ * one row of the root column, and those rows are ranked first, so the least
+ * covering's root row is never mapped to an earlier root row by the group.
+ * Root rows which are, are removed before searching. */
+#define SYMMETRY_LIMIT 65536
+
+static int
+compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+/* Non-zero if row has an element in column. */
+static int
+row_has(Element *row, Header *column)
+{
+    Element *e = row;
+    if (!row)
+        return 0;
+    do {
+        if (e->column == column)
+            return 1;
+        e = e->right;
+    } while (e != row);
+    return 0;
+}
+
+/* Non-zero if the group maps row, a row of column, to an earlier row of
+ * column. */
+static int
+Coverings_redundant_root(Coverings *self, Header *column, Element *row)
+{
+    int g;
+
+    for (g = 1; g < self->groupSize; g++) {
+        int image = self->group[(size_t)g * self->rowCount + row->row];
+        if (image < row->row && row_has(self->rows[image], column))
+            return 1;
+    }
+    return 0;
+}
+
+/* Return the size of the orbit of the current covering, or 0 if it is not
+ * the least in its orbit. */
+static int
+Coverings_orbit(Coverings *self)
+{
+    Cells *cells = self->cells;
+    int *rows = self->orbitRows;
+    int *least = rows + self->solutionCapacity;
+    int *image = least + self->solutionCapacity;
+    int stabilizer = 0;
+    int size = 0;
+    int g, i;
+
+    for (i = 0; i < self->solutionSize; i++) {
+        if (self->solution[i]->row >= 0)
+            rows[size++] = self->solution[i]->row;
+    }
+    for (i = 0; cells && i < cells->depth; i++) {
+        int node = cells->set[cells->first[cells->levelItem[i]] +
+                              cells->levelPos[i]];
+        rows[size++] = cells->layout->index[cells->owner[node]];
+    }
+
+    for (i = 0; i < size; i++)
+        least[i] = self->rank[rows[i]];
+    qsort(least, size, sizeof(int), compare_ints);
+
+    for (g = 0; g < self->groupSize; g++) {
+        int *perm = self->group + (size_t)g * self->rowCount;
+        for (i = 0; i < size; i++)
+            image[i] = self->rank[perm[rows[i]]];
+        qsort(image, size, sizeof(int), compare_ints);
+        for (i = 0; i < size && image[i] == least[i]; i++)
+            ;
+        if (i == size)
+            stabilizer++;
+        else if (image[i] < least[i])
+            return 0;
+    }
+    return self->groupSize / stabilizer;
+}
+
+/* Map item number index by symmetry, returning the image's number, or -1
+ * with an exception set. */
+static int
+Coverings_map_item(Coverings *self, PyObject *symmetry, PyObject *numbers,
+                   int index)
+{
+    PyObject *object = self->items[index]->object;
+    PyObject *image;
+    PyObject *number;
+
+    if (PyCallable_Check(symmetry)) {
+        image = PyObject_CallFunctionObjArgs(symmetry, object, NULL);
+    } else {
+        image = PyObject_GetItem(symmetry, object);
+        if (!image && PyErr_ExceptionMatches(PyExc_KeyError)) {
+            PyErr_Clear();
+            Py_INCREF(object);
+            image = object;
+        }
+    }
+    if (!image)
+        return -1;
+
+    number = PyDict_GetItem(numbers, image);
+    Py_DECREF(image);
+    if (!number) {
+        if (!PyErr_Occurred())
+            PyErr_SetString(PyExc_ValueError,
+                            "symmetry maps an element out of the matrix");
+        return -1;
+    }
+    return (int)PyInt_AsLong(number);
+}
+
+/* Return a tuple of the sorted numbers of row's items, mapped through map
+ * if it is not NULL. */
+static PyObject *
+row_key(Element *row, int *map, int *scratch)
+{
+    PyObject *key;
+    Element *e = row;
+    int size = 0;
+    int i;
+
+    if (row) {
+        do {
+            int index = e->column->index;
+            scratch[size++] = map ? map[index] : index;
+            e = e->right;
+        } while (e != row);
+    }
+    qsort(scratch, size, sizeof(int), compare_ints);
+
+    if (!(key = PyTuple_New(size)))
+        return NULL;
+    for (i = 0; i < size; i++) {
+        PyObject *number = PyInt_FromLong(scratch[i]);
+        if (!number) {
+            Py_DECREF(key);
+            return NULL;
+        }
+        PyTuple_SET_ITEM(key, i, number);
+    }
+    return key;
+}
+
+/* Turn symmetries, a list, into permutations of the rows, stored in perm
+ * one after another.  Identical rows are mapped in order.  Returns -1 on
+ * failure. */
+static int
+Coverings_map_rows(Coverings *self, PyObject *symmetries, int *perm)
+{
+    PyObject *numbers = PyDict_New();
+    PyObject *keys = PyDict_New();
+    int *map = PyMem_New(int, self->itemCount + 1);
+    int *seen = PyMem_New(int, self->itemCount + 1);
+    int *scratch = PyMem_New(int, self->itemCount + 1);
+    int *position = PyMem_New(int, self->rowCount + 1);
+    int result = -1;
+    int g, i;
+
+    if (!map || !seen || !scratch || !position) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    if (!numbers || !keys)
+        goto done;
+
+    for (i = 0; i < self->itemCount; i++) {
+        PyObject *number = PyInt_FromLong(i);
+        if (!number ||
+            PyDict_SetItem(numbers, self->items[i]->object, number) < 0) {
+            Py_XDECREF(number);
+            goto done;
+        }
+        Py_DECREF(number);
+    }
+
+    /* Group identical rows under their sorted items. */
+    for (i = 0; i < self->rowCount; i++) {
+        PyObject *key = row_key(self->rows[i], NULL, scratch);
+        PyObject *list;
+        PyObject *index;
+
+        if (!key)
+            goto done;
+        if (!(list = PyDict_GetItem(keys, key))) {
+            if (!(list = PyList_New(0)) ||
+                PyDict_SetItem(keys, key, list) < 0) {
+                Py_XDECREF(list);
+                Py_DECREF(key);
+                goto done;
+            }
+            Py_DECREF(list);
+        }
+        Py_DECREF(key);
+        position[i] = (int)PyList_GET_SIZE(list);
+        if (!(index = PyInt_FromLong(i)) || PyList_Append(list, index) < 0) {
+            Py_XDECREF(index);
+            goto done;
+        }
+        Py_DECREF(index);
+    }
+
+    for (g = 0; g < PyList_GET_SIZE(symmetries); g++) {
+        PyObject *symmetry = PyList_GET_ITEM(symmetries, g);
+
+        memset(seen, 0, self->itemCount * sizeof(int));
+        for (i = 0; i < self->itemCount; i++) {
+            int image = Coverings_map_item(self, symmetry, numbers, i);
+            if (image < 0)
+                goto done;
+            if (seen[image] ||
+                (self->items[i]->bound < 0) !=
+                (self->items[image]->bound < 0)) {
+                PyErr_SetString(PyExc_ValueError,
+                                "symmetry is not a permutation of the "
+                                "primary and secondary elements");
+                goto done;
+            }
+            seen[image] = 1;
+            map[i] = image;
+        }
+
+        for (i = 0; i < self->rowCount; i++) {
+            PyObject *key = row_key(self->rows[i], map, scratch);
+            PyObject *list;
+
+            if (!key)
+                goto done;
+            list = PyDict_GetItem(keys, key);
+            Py_DECREF(key);
+            if (!list || PyList_GET_SIZE(list) <= position[i]) {
+                PyErr_SetString(PyExc_ValueError,
+                                "symmetry does not map rows to rows");
+                goto done;
+            }
+            perm[(size_t)g * self->rowCount + i] =
+                (int)PyInt_AsLong(PyList_GET_ITEM(list, position[i]));
+        }
+    }
+    result = 0;
+
+done:
+    Py_XDECREF(numbers);
+    Py_XDECREF(keys);
+    PyMem_Del(map);
+    PyMem_Del(seen);
+    PyMem_Del(scratch);
+    PyMem_Del(position);
+    return result;
+}
+
+/* Close the generating permutations under composition, starting from the
+ * identity, into self->group.  Returns -1 on failure. */
+static int
+Coverings_close_group(Coverings *self, int *generators, int count)
+{
+    size_t rowBytes = self->rowCount * sizeof(int);
+    PyObject *known = PyDict_New();
+    PyObject *key;
+    int capacity = 8;
+    int g, k, i;
+
+    if (!known)
+        return -1;
+    self->group = PyMem_New(int, (size_t)capacity * self->rowCount + 1);
+    if (!self->group)
+        goto nomemory;
+    for (i = 0; i < self->rowCount; i++)
+        self->group[i] = i;
+    self->groupSize = 1;
+    key = PyBytes_FromStringAndSize((char *)self->group, rowBytes);
+    if (!key || PyDict_SetItem(known, key, Py_None) < 0) {
+        Py_XDECREF(key);
+        goto error;
+    }
+    Py_DECREF(key);
+
+    for (k = 0; k < self->groupSize; k++) {
+        for (g = 0; g < count; g++) {
+            int *gen = generators + (size_t)g * self->rowCount;
+            int *perm, *next;
+            int found;
+
+            if (self->groupSize == capacity) {
+                int *group = self->group;
+                if (capacity >= SYMMETRY_LIMIT) {
+                    PyErr_SetString(PyExc_ValueError,
+                                    "symmetry group is too large");
+                    goto error;
+                }
+                capacity *= 2;
+                if (!PyMem_Resize(group, int,
+                                  (size_t)capacity * self->rowCount + 1))
+                    goto nomemory;
+                self->group = group;
+            }
+
+            perm = self->group + (size_t)k * self->rowCount;
+            next = self->group + (size_t)self->groupSize * self->rowCount;
+            for (i = 0; i < self->rowCount; i++)
+                next[i] = gen[perm[i]];
+            if (!(key = PyBytes_FromStringAndSize((char *)next, rowBytes)))
+                goto error;
+            found = PyDict_Contains(known, key);
+            if (found == 0)
+                found = PyDict_SetItem(known, key, Py_None) < 0 ? -1 : 0;
+            Py_DECREF(key);
+            if (found < 0)
+                goto error;
+            if (found == 0)
+                self->groupSize++;
+        }
+    }
+
+    Py_DECREF(known);
+    return 0;
+
+nomemory:
+    PyErr_NoMemory();
+error:
+    Py_DECREF(known);
+    return -1;
+}
+
+/* Pick the root column that the most rows can be removed from, rank its
+ * rows first, and remove the rows the group maps to earlier root rows. */
+static void
+Coverings_break_symmetry(Coverings *self)
+{
+    Header *root = NULL;
+    Header *column;
+    Element *row, *next;
+    int most = -1;
+    int r, n;
+
+    for (column = (Header *)self->corner->e.right; column != self->corner;
+         column = (Header *)column->e.right) {
+        int count = 0;
+        for (row = column->e.down; row != &column->e; row = row->down)
+            count += Coverings_redundant_root(self, column, row);
+        if (count > most) {
+            root = column;
+            most = count;
+        }
+    }
+
+    n = 0;
+    for (r = 0; r < self->rowCount; r++) {
+        if (root && row_has(self->rows[r], root))
+            self->rank[r] = n++;
+    }
+    for (r = 0; r < self->rowCount; r++) {
+        if (!root || !row_has(self->rows[r], root))
+            self->rank[r] = n++;
+    }
+
+    for (row = root ? root->e.down : NULL; row && row != &root->e;
+         row = next) {
+        next = row->down;
+        if (Coverings_redundant_root(self, root, row))
+            remove_row(row);
+    }
+}
+
+/* Set up the search to produce one covering from each orbit under the
+ * group generated by symmetries.  Returns -1 on failure. */
+static int
+Coverings_symmetries(Coverings *self, PyObject *symmetries)
+{
+    PyObject *list = PySequence_List(symmetries);
+    int *generators = NULL;
+    int result = -1;
+    Py_ssize_t count;
+
+    if (!list)
+        return -1;
+    count = PyList_GET_SIZE(list);
+    if (count > INT_MAX / (self->rowCount + 1)) {
+        PyErr_SetString(PyExc_ValueError, "too many symmetries");
+        goto done;
+    }
+    generators = PyMem_New(int, count * self->rowCount + 1);
+    self->rank = PyMem_New(int, self->rowCount + 1);
+    self->orbitRows = PyMem_New(int, 3 * self->solutionCapacity + 1);
+    if (!generators || !self->rank || !self->orbitRows) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    if (Coverings_map_rows(self, list, generators) < 0 ||
+        Coverings_close_group(self, generators, (int)count) < 0)
+        goto done;
+
+    Coverings_break_symmetry(self);
+    result = 0;
+
+done:
+    Py_DECREF(list);
+    PyMem_Del(generators);
+    return result;
+}
+
+/* ------------------------------------------------------------------------ *
+ * Optimization                                                             *
+ * ------------------------------------------------------------------------ */
+
+/* Depth first branch and bound for the covering of least total cost.  Each
+ * row's cost is shared out evenly among its primary columns; every uncovered
+ * column must take at least the least share of the rows left in it, so the
+ * sum of those is a lower bound on the cost of finishing.  Costs are never
+ * negative. */
+typedef struct {
+    /* Each row's share of its cost per primary column. */
+    double *share;
+
+    /* The best covering so far, as row indices. */
+    int *rows;
+    int size;
+    double cost;
+    int found;
+} Best;
+
+/* Lower bound on the cost of covering the remaining columns. */
+static double
+Coverings_lower_bound(Coverings *self, Best *best)
+{
+    Header *column = (Header *)self->corner->e.right;
+    double bound = 0;
+
+    for (; column != self->corner; column = (Header *)column->e.right) {
+        Element *row = column->e.down;
+        double least = best->share[row->row];
+        for (row = row->down; row != &column->e; row = row->down) {
+            if (best->share[row->row] < least)
+                least = best->share[row->row];
+        }
+        bound += least;
+    }
+    return bound;
+}
+
+static void
+Coverings_branch(Coverings *self, Best *best, double cost)
+{
+    Header *column = smallest_column(self->corner);
+    Element *row;
+
+    if (column == NULL) {
+        if (!best->found || cost < best->cost) {
+            int i;
+            for (i = 0; i < self->solutionSize; i++)
+                best->rows[i] = self->solution[i]->row;
+            best->size = self->solutionSize;
+            best->cost = cost;
+            best->found = 1;
+        }
+        return;
+    } else if (column->count == 0) {
+        return;
+    }
+    if (best->found &&
+        cost + Coverings_lower_bound(self, best) >= best->cost)
+        return;
+
+    for (row = column->e.down; row != &column->e; row = row->down) {
+        unlink_row(row);
+        self->solution[self->solutionSize++] = row;
+        Coverings_branch(self, best, cost + self->costs[row->row]);
+        self->solutionSize--;
+        link_row(row);
+    }
+}
+
+static char Coverings_best__doc__[] =
+"best() -> (tuple, float) or None\n"
+"\n"
+"Return the covering of least total cost, with its cost, or None if there\n"
+"is no covering.  Requires costs.  Must be called before iteration\n"
+"starts, and does not support bounds or symmetries.\n";
+
+/* .best() */
+static PyObject *
+Coverings_best(Coverings *self)
+{
+    PyObject *result = NULL;
+    PyObject *tuple;
+    Best best;
+    double cost = 0;
+    int i;
+
+    if (!Coverings_has_matrix(self, "best"))
+        return NULL;
+    if (!self->costs) {
+        PyErr_SetString(PyExc_ValueError, "best() requires costs");
+        return NULL;
+    }
+    if (!self->first) {
+        PyErr_SetString(PyExc_ValueError,
+                        "best() must be called before iteration");
+        return NULL;
+    }
+    if (self->multiplicity || self->group) {
+        PyErr_SetString(PyExc_ValueError,
+                        "best() does not support bounds or symmetries");
+        return NULL;
+    }
+
+    best.share = PyMem_New(double, self->rowCount + 1);
+    best.rows = PyMem_New(int, self->solutionCapacity + 1);
+    best.size = 0;
+    best.cost = 0;
+    best.found = 0;
+    if (!best.share || !best.rows) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (i = 0; i < self->rowCount; i++) {
+        Element *e = self->rows[i];
+        int primary = 0;
+        if (e) {
+            do {
+                primary += e->column->bound > 0;
+                e = e->right;
+            } while (e != self->rows[i]);
+        }
+        best.share[i] = primary ? self->costs[i] / primary : 0;
+    }
+    for (i = 0; i < self->base; i++)
+        cost += self->costs[self->solution[i]->row];
+
+    Coverings_branch(self, &best, cost);
+
+    if (!best.found) {
+        Py_INCREF(Py_None);
+        result = Py_None;
+        goto done;
+    }
+    if (!(tuple = PyTuple_New(best.size)))
+        goto done;
+    for (i = 0; i < best.size; i++) {
+        PyObject *object = self->rows[best.rows[i]]->object;
+        Py_INCREF(object);
+        PyTuple_SET_ITEM(tuple, i, object);
+    }
+    result = Py_BuildValue("(Nd)", tuple, best.cost);
+
+done:
+    PyMem_Del(best.share);
+    PyMem_Del(best.rows);
+    return result;
+}
+
+/* ------------------------------------------------------------------------ *
+ * Portfolio                                                                *
+ * ------------------------------------------------------------------------ */
+
+/* The outcome of a portfolio race.  The first search to finish, with a
+ * covering or with the proof that there is none, wins and cancels the rest.
+ * winner and outcome are guarded by mutex. */
+typedef struct {
+    PyThread_type_lock mutex;
+    volatile int cancel;
+    int winner;
+    int outcome;
+} Race;
+
+/* One search of a portfolio, on its own thread.  done is held until the
+ * search has finished. */
+typedef struct {
+    Coverings *search;
+    Race *race;
+    PyThread_type_lock done;
+    int index;
+} Runner;
+
+/* Thread body.  Runs without the GIL, touching only its own search. */
+static void
+Portfolio_run(void *arg)
+{
+    Runner *runner = (Runner *)arg;
+    Race *race = runner->race;
+    int outcome = Coverings_search(runner->search, &race->cancel);
+
+    PyThread_acquire_lock(race->mutex, WAIT_LOCK);
+    if (outcome != SEARCH_CANCELLED && race->winner < 0) {
+        race->winner = runner->index;
+        race->outcome = outcome;
+        race->cancel = 1;
+    }
+    PyThread_release_lock(race->mutex);
+    PyThread_release_lock(runner->done);
+}
+
+static char Coverings_portfolio__doc__[] =
+"Coverings.portfolio(rows, configurations, **kwds) -> (int, tuple or None)\n"
+"\n"
+"Race several searches for a first covering of rows, one per thread.\n"
+"configurations is a sequence of dicts of Coverings() keyword arguments,\n"
+"each merged over kwds, such as {'heuristic': 'weighted'} or\n"
+"{'seed': 1, 'restarts': 'luby'}.  Every search has its own matrix and runs\n"
+"without the GIL.  The first to find a covering, or to prove there is\n"
+"none, wins and the others are cancelled.  Returns the index of the\n"
+"winning configuration and its covering, or None.\n";
+
+/* Coverings.portfolio() */
+static PyObject *
+Coverings_portfolio(PyObject *type, PyObject *args, PyObject *kwds)
+{
+    PyObject *rows;
+    PyObject *configurations;
+    PyObject *list = NULL;
+    PyObject *configs = NULL;
+    PyObject *searches = NULL;
+    PyObject *result = NULL;
+    Runner *runners = NULL;
+    Race race;
+    Py_ssize_t count;
+    Py_ssize_t started = 0;
+    Py_ssize_t i;
+
+    if (!PyArg_ParseTuple(args, "OO:portfolio", &rows, &configurations))
+        return NULL;
+
+    race.mutex = NULL;
+    race.cancel = 0;
+    race.winner = -1;
+    race.outcome = SEARCH_DONE;
+
+    /* Build every search under the GIL, over the same list of rows. */
+    if (!(list = PySequence_List(rows)))
+        goto done;
+    if (!(configs = PySequence_Fast(configurations,
+                                    "configurations must be a sequence")))
+        goto done;
+    count = PySequence_Fast_GET_SIZE(configs);
+    if (count == 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "portfolio() requires a configuration");
+        goto done;
+    }
+    if (!(searches = PyList_New(count)))
+        goto done;
+    for (i = 0; i < count; i++) {
+        PyObject *config = PySequence_Fast_GET_ITEM(configs, i);
+        PyObject *ctorArgs;
+        PyObject *search;
+        PyObject *kw;
+
+        kw = kwds ? PyDict_Copy(kwds) : PyDict_New();
+        if (!kw)
+            goto done;
+        if (PyDict_Merge(kw, config, 1) < 0) {
+            Py_DECREF(kw);
+            goto done;
+        }
+        ctorArgs = PyTuple_Pack(1, list);
+        search = ctorArgs ? PyObject_Call(type, ctorArgs, kw) : NULL;
+        Py_XDECREF(ctorArgs);
+        Py_DECREF(kw);
+        if (!search)
+            goto done;
+        PyList_SET_ITEM(searches, i, search);
+        if (Coverings_start((Coverings *)search) < 0)
+            goto done;
+    }
+
+    runners = PyMem_New(Runner, count);
+    race.mutex = PyThread_allocate_lock();
+    if (!runners || !race.mutex) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (started = 0; started < count; started++) {
+        Runner *runner = &runners[started];
+
+        runner->search = (Coverings *)PyList_GET_ITEM(searches, started);
+        runner->race = &race;
+        runner->index = (int)started;
+        if (!(runner->done = PyThread_allocate_lock())) {
+            PyErr_NoMemory();
+            break;
+        }
+        PyThread_acquire_lock(runner->done, WAIT_LOCK);
+        if (PyThread_start_new_thread(Portfolio_run, runner) ==
+            PYTHREAD_INVALID_THREAD_ID) {
+            PyThread_release_lock(runner->done);
+            PyThread_free_lock(runner->done);
+            PyErr_SetString(PyExc_RuntimeError, "can't start new thread");
+            break;
+        }
+    }
+
+    /* Wait for every thread, cancelling them all if one failed to start. */
+    Py_BEGIN_ALLOW_THREADS
+    if (started < count) {
+        PyThread_acquire_lock(race.mutex, WAIT_LOCK);
+        race.cancel = 1;
+        PyThread_release_lock(race.mutex);
+    }
+    for (i = 0; i < started; i++) {
+        PyThread_acquire_lock(runners[i].done, WAIT_LOCK);
+        PyThread_release_lock(runners[i].done);
+        PyThread_free_lock(runners[i].done);
+    }
+    Py_END_ALLOW_THREADS
+    if (started < count)
+        goto done;
+
+    if (race.outcome == SEARCH_FOUND) {
+        Coverings *winner =
+            (Coverings *)PyList_GET_ITEM(searches, race.winner);
+        result = Py_BuildValue("(iN)", race.winner, Coverings_found(winner));
+    } else {
+        result = Py_BuildValue("(iO)", race.winner, Py_None);
+    }
+
+done:
+    if (race.mutex)
+        PyThread_free_lock(race.mutex);
+    PyMem_Del(runners);
+    Py_XDECREF(searches);
+    Py_XDECREF(configs);
+    Py_XDECREF(list);
+    return result;
+}
+
+/* ------------------------------------------------------------------------ *
+ * Duplicates                                                               *
+ * ------------------------------------------------------------------------ */
+
+static void Coverings_drop_row(Coverings *self, int r);
+
+/* Return a key which is the same for rows with the same items and colors:
+ * the sorted numbers of the items, followed by their colors if any row has
+ * one.  scratch has room for the row, and colors for every item. */
+static PyObject *
+Coverings_row_identity(Coverings *self, Element *row, int *scratch,
+                       int *colors)
+{
+    PyObject *key = row_key(row, NULL, scratch);
+    PyObject *identity;
+    Py_ssize_t size;
+    Py_ssize_t i;
+    Element *e = row;
+
+    if (!key || !self->colored)
+        return key;
+    do {
+        colors[e->column->index] = e->color;
+        e = e->right;
+    } while (e != row);
+
+    size = PyTuple_GET_SIZE(key);
+    if (!(identity = PyTuple_New(2 * size))) {
+        Py_DECREF(key);
+        return NULL;
+    }
+    for (i = 0; i < size; i++) {
+        PyObject *item = PyTuple_GET_ITEM(key, i);
+        PyObject *color = PyInt_FromLong(colors[PyInt_AsLong(item)]);
+        if (!color) {
+            Py_DECREF(key);
+            Py_DECREF(identity);
+            return NULL;
+        }
+        Py_INCREF(item);
+        PyTuple_SET_ITEM(identity, i, item);
+        PyTuple_SET_ITEM(identity, size + i, color);
+    }
+    Py_DECREF(key);
+    return identity;
+}
+
+/* Merge every row into the first row identical to it, which keeps a list of
+ * their objects, and drop it from the matrix.  Empty rows are never chosen,
+ * so they are left alone.  Returns -1 on failure. */
+static int
+Coverings_merge_rows(Coverings *self)
+{
+    PyObject *firsts = PyDict_New();
+    int *scratch = NULL;
+    int *colors = PyMem_New(int, self->itemCount + 1);
+    int longest = 0;
+    int result = -1;
+    int i;
+
+    self->copies = PyMem_New(PyObject *, self->rowCount + 1);
+    self->merged = PyMem_New(int, self->rowCount + 1);
+    self->choice = PyMem_New(int, self->rowCount + 1);
+    self->copyCount = PyMem_New(int, self->rowCount + 1);
+    if (!self->copies || !self->merged || !self->choice ||
+        !self->copyCount || !colors) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    memset(self->copies, 0, self->rowCount * sizeof(PyObject *));
+    memset(self->choice, 0, self->rowCount * sizeof(int));
+    if (!firsts)
+        goto done;
+
+    for (i = 0; i < self->rowCount; i++) {
+        Element *e = self->rows[i];
+        int length = 0;
+        if (e) {
+            do {
+                length++;
+                e = e->right;
+            } while (e != self->rows[i]);
+        }
+        if (length > longest)
+            longest = length;
+    }
+    if (!(scratch = PyMem_New(int, longest + 1))) {
+        PyErr_NoMemory();
+        goto done;
+    }
+
+    for (i = 0; i < self->rowCount; i++) {
+        PyObject *key;
+        PyObject *first;
+        PyObject **copies;
+        int f;
+
+        self->merged[i] = i;
+        if (!self->rows[i])
+            continue;
+        if (!(key = Coverings_row_identity(self, self->rows[i], scratch,
+                                           colors)))
+            goto done;
+        if (!(first = PyDict_GetItemWithError(firsts, key))) {
+            PyObject *number = PyErr_Occurred() ? NULL : PyInt_FromLong(i);
+            int failed = !number || PyDict_SetItem(firsts, key, number) < 0;
+            Py_XDECREF(number);
+            Py_DECREF(key);
+            if (failed)
+                goto done;
+            continue;
+        }
+        Py_DECREF(key);
+
+        f = (int)PyInt_AsLong(first);
+        copies = &self->copies[f];
+        if (!*copies) {
+            if (!(*copies = PyList_New(1)))
+                goto done;
+            Py_INCREF(self->rows[f]->object);
+            PyList_SET_ITEM(*copies, 0, self->rows[f]->object);
+        }
+        if (PyList_Append(*copies, self->rows[i]->object) < 0)
+            goto done;
+        self->merged[i] = f;
+        Coverings_drop_row(self, i);
+    }
+    result = 0;
+
+done:
+    Py_XDECREF(firsts);
+    PyMem_Del(scratch);
+    PyMem_Del(colors);
+    return result;
+}
+
+/* ------------------------------------------------------------------------ *
+ * Locality                                                                 *
+ * ------------------------------------------------------------------------ */
+
+/* The matrix is built a node at a time, so the elements of a column are
+ * scattered over the heap in input order.  A relayout numbers the columns
+ * afresh and copies the headers into one array and the elements into one
+ * block, a row at a time, taking the rows of each column in turn.  Rows met
+ * together when a column is covered then sit side by side. */
+
+/* qsort() order of columns by count, then by number. */
+static int
+compare_counts(const void *a, const void *b)
+{
+    const Header *x = *(const Header *const *)a;
+    const Header *y = *(const Header *const *)b;
+
+    if (x->count != y->count)
+        return x->count < y->count ? -1 : 1;
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/* Put the columns, sorted by count in byCount, in reverse Cuthill-McKee
+ * order: breadth first over columns sharing rows, from the sparsest column
+ * not yet reached, taking neighbors sparsest first, then reversed.  Columns
+ * close in the order then share most of their rows.  seen has room for a
+ * mark per column. */
+static void
+Coverings_cuthill_mckee(Coverings *self, Header **byCount, Header **order,
+                        int *seen)
+{
+    int head = 0;
+    int tail = 0;
+    int i, j;
+
+    memset(seen, 0, self->itemCount * sizeof(int));
+    for (i = 0; i < self->itemCount; i++) {
+        if (seen[byCount[i]->index])
+            continue;
+        seen[byCount[i]->index] = 1;
+        order[tail++] = byCount[i];
+
+        while (head < tail) {
+            Header *column = order[head++];
+            int first = tail;
+            Element *row;
+
+            for (row = column->e.down; row != &column->e; row = row->down) {
+                Element *e;
+                for (e = row->right; e != row; e = e->right) {
+                    if (!seen[e->column->index]) {
+                        seen[e->column->index] = 1;
+                        order[tail++] = e->column;
+                    }
+                }
+            }
+            qsort(order + first, tail - first, sizeof(Header *),
+                  compare_counts);
+        }
+    }
+
+    for (i = 0, j = self->itemCount - 1; i < j; i++, j--) {
+        Header *column = order[i];
+        order[i] = order[j];
+        order[j] = column;
+    }
+}
+
+/* The new place of an old element or header, kept in its left link once it
+ * has been copied. */
+#define MOVED(e) ((e)->left)
+
+/* Copy row r to node onwards, unless it has been already.  Returns where
+ * the next row goes. */
+static Element *
+Coverings_place_row(Coverings *self, int r, int *placed, Element *node)
+{
+    Element *first = self->rows[r];
+    Element *e = first;
+
+    if (!first || placed[r])
+        return node;
+    placed[r] = 1;
+    do {
+        *node = *e;
+        MOVED(e) = node++;
+        e = e->right;
+    } while (e != first);
+    return node;
+}
+
+/* Renumber the columns by method, "count" or "rcm", and pack the headers and
+ * elements into memory in that order.  Nothing may be on the stack.  Returns
+ * -1 on failure, leaving the matrix as it was. */
+static int
+Coverings_relayout(Coverings *self, const char *method)
+{
+    Header **order = PyMem_New(Header *, self->itemCount + 1);
+    Header **byCount = PyMem_New(Header *, self->itemCount + 1);
+    int *seen = PyMem_New(int, self->itemCount + self->rowCount + 1);
+    Header *headers = PyMem_New(Header, self->itemCount + 1);
+    PyObject *addresses = PyList_New(0);
+    Element *nodes = NULL;
+    Element *node;
+    Py_ssize_t pos = 0;
+    Py_ssize_t k = 0;
+    PyObject *key, *value;
+    size_t size = 0;
+    int result = -1;
+    int i, r;
+
+    for (r = 0; r < self->rowCount; r++) {
+        Element *e = self->rows[r];
+        if (!e)
+            continue;
+        do {
+            size++;
+            e = e->right;
+        } while (e != self->rows[r]);
+    }
+    if (!order || !byCount || !seen || !headers ||
+        !(nodes = PyMem_New(Element, size + 1))) {
+        PyErr_NoMemory();
+        goto done;
+    }
+    if (!addresses)
+        goto done;
+
+    memcpy(byCount, self->items, self->itemCount * sizeof(Header *));
+    qsort(byCount, self->itemCount, sizeof(Header *), compare_counts);
+    if (strcmp(method, "rcm") == 0)
+        Coverings_cuthill_mckee(self, byCount, order, seen);
+    else
+        memcpy(order, byCount, self->itemCount * sizeof(Header *));
+
+    /* The new addresses of the headers in the column index are made before
+     * anything moves, so the rest cannot fail. */
+    for (i = 0; i < self->itemCount; i++)
+        seen[order[i]->index] = i;
+    while (PyDict_Next(self->columns.dict, &pos, &key, &value)) {
+        Header *old = (Header *)PyLong_AsVoidPtr(value);
+        PyObject *address = PyLong_FromVoidPtr(&headers[seen[old->index]]);
+        if (!address || PyList_Append(addresses, address) < 0) {
+            Py_XDECREF(address);
+            goto done;
+        }
+        Py_DECREF(address);
+    }
+
+    /* Copy the rows as the columns reach them, then any rows no column
+     * holds, then the headers. */
+    memset(seen, 0, self->rowCount * sizeof(int));
+    node = nodes;
+    for (i = 0; i < self->itemCount; i++) {
+        Element *e;
+        for (e = order[i]->e.down; e != &order[i]->e; e = e->down)
+            node = Coverings_place_row(self, e->row, seen, node);
+    }
+    for (r = 0; r < self->rowCount; r++)
+        node = Coverings_place_row(self, r, seen, node);
+    for (i = 0; i < self->itemCount; i++) {
+        headers[i] = *order[i];
+        headers[i].index = i;
+        headers[i].e.column = &headers[i];
+        MOVED(&order[i]->e) = &headers[i].e;
+    }
+
+    /* Point the copies at each other, and relink the header chains in the
+     * new order. */
+    for (node = nodes; node < nodes + size; node++) {
+        node->up = MOVED(node->up);
+        node->down = MOVED(node->down);
+        node->left = MOVED(node->left);
+        node->right = MOVED(node->right);
+        node->column = (Header *)MOVED(&node->column->e);
+    }
+    self->corner->e.left = self->corner->e.right = &self->corner->e;
+    self->secondary->e.left = self->secondary->e.right =
+        &self->secondary->e;
+    for (i = 0; i < self->itemCount; i++) {
+        Header *column = &headers[i];
+        Header *chain = column->bound < 0 ? self->secondary : self->corner;
+
+        column->e.up = MOVED(column->e.up);
+        column->e.down = MOVED(column->e.down);
+        column->e.right = &chain->e;
+        column->e.left = chain->e.left;
+        chain->e.left->right = &column->e;
+        chain->e.left = &column->e;
+        self->items[i] = column;
+    }
+    pos = 0;
+    while (PyDict_Next(self->columns.dict, &pos, &key, &value))
+        PyDict_SetItem(self->columns.dict, key,
+                       PyList_GET_ITEM(addresses, k++));
+
+    /* Free the old nodes.  Their objects now belong to the copies. */
+    for (r = 0; r < self->rowCount; r++) {
+        Element *first = self->rows[r];
+        Element *e, *next;
+
+        if (!first)
+            continue;
+        self->rows[r] = MOVED(first);
+        for (e = first->right; e != first; e = next) {
+            next = e->right;
+            PyMem_Del(e);
+        }
+        PyMem_Del(first);
+    }
+    for (i = 0; i < self->itemCount; i++)
+        PyMem_Del(order[i]);
+
+    self->elements = nodes;
+    self->headers = headers;
+    nodes = NULL;
+    headers = NULL;
+    result = 0;
+
+done:
+    PyMem_Del(order);
+    PyMem_Del(byCount);
+    PyMem_Del(seen);
+    PyMem_Del(headers);
+    PyMem_Del(nodes);
+    Py_XDECREF(addresses);
+    return result;
+}
+
+#undef MOVED
+
+/* ------------------------------------------------------------------------ *
+ * Editing                                                                  *
+ * ------------------------------------------------------------------------ */
+
+/* Rows may be added and removed whenever next() is not running.  The search
+ * is taken back to its prefix, the rows are spliced into or out of their
+ * columns, and the next call to next() starts the search again.  Nothing
+ * else is rebuilt, so the cost is in proportion to the change. */
+
+static int Coverings_parse_entry(Coverings *self, PyObject *entry,
+                                 Header **column, int *color);
+
+/* Append cover to the matrix as a new row, making any new primary columns.
+ * Returns -1 on failure, when the row may be partly built; it is in the
+ * row index even so, to be freed. */
+static int
+Coverings_append_row(Coverings *self, PyObject *cover)
+{
+    PyObject *it;
+    PyObject *elem;
+    Element *row = NULL;
+
+    /* Grow the row index by doubling. */
+    if ((self->rowCount & (self->rowCount - 1)) == 0) {
+        Element **rows = self->rows;
+        if (!PyMem_Resize(rows, Element *,
+                          self->rowCount ? 2 * self->rowCount : 1)) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->rows = rows;
+    }
+    self->rows[self->rowCount++] = NULL;
+
+    if (!(it = PyObject_GetIter(cover)))
+        return -1;
+    while ((elem = PyIter_Next(it))) {
+        Element *e = NULL;
+        Header *column;
+        int color;
+        if (Coverings_parse_entry(self, elem, &column, &color) < 0)
+            goto error;
+
+        /* Create element */
+        e = PyMem_New(Element, 1);
+        if (!e) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        e->column = column;
+        e->row = self->rowCount - 1;
+        e->color = color;
+        self->colored |= color != 0;
+        Py_INCREF(cover);
+        e->object = cover;
+        column->count++;
+
+        /* Link into column */
+        e->up = column->e.up;
+        e->down = &column->e;
+        column->e.up->down = e;
+        column->e.up = e;
+
+        /* Link into row */
+        if (row == NULL) {
+            row = e;
+            e->left = e;
+            e->right = e;
+        } else {
+            e->left = row->left;
+            e->right = row;
+            row->left->right = e;
+            row->left = e;
+        }
+        self->rows[self->rowCount - 1] = row;
+
+        Py_DECREF(elem);
+    }
+    Py_DECREF(it);
+    return PyErr_Occurred() ? -1 : 0;
+
+error:
+    Py_DECREF(elem);
+    Py_DECREF(it);
+    return -1;
+}
+
+/* Unlink row r from its columns, unless reduce() already has, and free
+ * it. */
+static void
+Coverings_drop_row(Coverings *self, int r)
+{
+    Element *row = self->rows[r];
+    Element *e;
+
+    if (!row)
+        return;
+    if (row->up->down == row) {
+        e = row;
+        do {
+            e->up->down = e->down;
+            e->down->up = e->up;
+            e->column->count--;
+            e = e->right;
+        } while (e != row);
+    }
+    free_rows(self->rows + r, 1, self->elements != NULL);
+    self->rows[r] = NULL;
+}
+
+/* Free the primary columns made since the columns were last numbered, which
+ * must have no rows left.  The pending exception, if any, is kept. */
+static void
+Coverings_drop_new_columns(Coverings *self)
+{
+    PyObject *type, *value, *traceback;
+    Header *column;
+    Header *next;
+
+    PyErr_Fetch(&type, &value, &traceback);
+    for (column = (Header *)self->corner->e.right; column != self->corner;
+         column = next) {
+        next = (Header *)column->e.right;
+        if (column->index >= 0)
+            continue;
+        assert(column->count == 0);
+        column->e.left->right = column->e.right;
+        column->e.right->left = column->e.left;
+        if (PyDict_DelItem(self->columns.dict, column->object) < 0) {
+            PyErr_Clear();
+            self->columns.unhashable--;
+        }
+        Py_DECREF(column->object);
+        PyMem_Del(column);
+    }
+    PyErr_Restore(type, value, traceback);
+}
+
+/* Number the columns made by new rows, and grow everything sized by the
+ * rows or columns to match.  Returns -1 on failure, having changed nothing
+ * but the sizes. */
+static int
+Coverings_grow(Coverings *self)
+{
+    Header **items = self->items;
+    Element **solution = self->solution;
+    Header *column;
+    long capacity;
+    int added = 0;
+
+    for (column = (Header *)self->corner->e.right; column != self->corner;
+         column = (Header *)column->e.right)
+        added += column->index < 0;
+
+    /* Each new column is covered once more, or finished. */
+    capacity = self->solutionCapacity + 2L * added;
+    if (capacity > INT_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "too many elements");
+        return -1;
+    }
+    if (!PyMem_Resize(items, Header *, self->itemCount + added + 1))
+        goto nomemory;
+    self->items = items;
+    if (!PyMem_Resize(solution, Element *, capacity + 1))
+        goto nomemory;
+    self->solution = solution;
+    if (self->multiplicity) {
+        int *tweakBase = self->tweakBase;
+        Element **tweaks = self->tweaks;
+        if (!PyMem_Resize(tweakBase, int, capacity + 1))
+            goto nomemory;
+        self->tweakBase = tweakBase;
+        if (!PyMem_Resize(tweaks, Element *, self->rowCount + 1))
+            goto nomemory;
+        self->tweaks = tweaks;
+    }
+    if (self->random) {
+        Element **scratch = self->scratch;
+        Element **saved = self->saved;
+        if (!PyMem_Resize(scratch, Element *, self->rowCount + 1))
+            goto nomemory;
+        self->scratch = scratch;
+        if (!PyMem_Resize(saved, Element *, capacity + 1))
+            goto nomemory;
+        self->saved = saved;
+    }
+
+    for (column = (Header *)self->corner->e.right; column != self->corner;
+         column = (Header *)column->e.right) {
+        if (column->index < 0) {
+            column->index = self->itemCount;
+            self->items[self->itemCount++] = column;
+        }
+    }
+    self->solutionCapacity = (int)capacity;
+    return 0;
+
+nomemory:
+    PyErr_NoMemory();
+    return -1;
+}
+
+/* Check that the rows of self may be changed. */
+static int
+Coverings_can_edit(Coverings *self, const char *method)
+{
+    if (!Coverings_has_matrix(self, method))
+        return 0;
+    if (self->group || self->costs || self->rowOrder || self->copies ||
+        self->elements) {
+        PyErr_Format(PyExc_ValueError, "%s() does not support symmetries, "
+                     "costs, row_key, merged duplicates or relayout",
+                     method);
+        return 0;
+    }
+    if (self->reduced) {
+        PyErr_Format(PyExc_ValueError, "%s() cannot be called after reduce()",
+                     method);
+        return 0;
+    }
+    return 1;
+}
+
+/* Take the search back to before its first step, with nothing on the stack
+ * and no cells, so the matrix may be changed.  The prefix is saved in
+ * *prefix for Coverings_rewind(), and, if the search had started, the rest
+ * of the stack in the trail.  Returns -1 on failure. */
+static int
+Coverings_unwind(Coverings *self, Element ***prefix)
+{
+    int i;
+
+    if (!self->first) {
+        int size = 2 * (self->solutionSize - self->base);
+        int *trail = self->trail;
+        if (!PyMem_Resize(trail, int, size + 1)) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        self->trail = trail;
+        self->trailSize = 0;
+        for (i = self->base; i < self->solutionSize; i++) {
+            trail[self->trailSize++] = self->solution[i]->column->index;
+            trail[self->trailSize++] = self->solution[i]->row;
+        }
+    }
+    if (!(*prefix = PyMem_New(Element *, self->base + 1))) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    memcpy(*prefix, self->solution, self->base * sizeof(Element *));
+    while (self->solutionSize > 0)
+        Coverings_pop(self);
+    free_cells(self->cells);
+    self->cells = NULL;
+
+    /* Forks keep the layout of the rows they were made from. */
+    Py_CLEAR(self->layout);
+    return 0;
+}
+
+/* Choose the prefix saved by Coverings_unwind() again, and start over. */
+static void
+Coverings_rewind(Coverings *self, Element **prefix)
+{
+    int size = self->base;
+
+    if (self->random)
+        Coverings_shuffle(self);
+    for (self->base = 0; self->base < size; self->base++)
+        Coverings_choose(self, prefix[self->base]);
+    PyMem_Del(prefix);
+    self->first = 1;
+}
+
+static char Coverings_add_rows__doc__[] =
+"add_rows(rows) -> list of indices\n"
+"\n"
+"Add rows, numbered after those already there, and return their indices.\n"
+"Elements not seen before become new elements to cover.  The iteration\n"
+"starts over with the next call to next(), keeping any prefix.  Only the\n"
+"new rows are built, however large the rest.  Does not support\n"
+"symmetries, costs or row_key, nor a matrix simplified by reduce().\n";
+
+/* .add_rows() */
+static PyObject *
+Coverings_add_rows(Coverings *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"rows", NULL};
+    PyObject *rows;
+    PyObject *it;
+    PyObject *cover;
+    PyObject *result = NULL;
+    Element **prefix;
+    int old = self->rowCount;
+    int r;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O:add_rows", kwlist,
+                                     &rows))
+        return NULL;
+    if (!Coverings_can_edit(self, "add_rows"))
+        return NULL;
+    if (!(it = PyObject_GetIter(rows)))
+        return NULL;
+    if (Coverings_unwind(self, &prefix) < 0) {
+        Py_DECREF(it);
+        return NULL;
+    }
+
+    while ((cover = PyIter_Next(it))) {
+        int failed = self->rowCount == INT_MAX ||
+                     Coverings_append_row(self, cover) < 0;
+        Py_DECREF(cover);
+        if (failed) {
+            if (!PyErr_Occurred())
+                PyErr_SetString(PyExc_OverflowError, "too many rows");
+            break;
+        }
+    }
+    Py_DECREF(it);
+
+    if (!PyErr_Occurred() && (result = PyList_New(self->rowCount - old))) {
+        for (r = old; r < self->rowCount; r++) {
+            PyObject *index = PyInt_FromLong(r);
+            if (!index) {
+                Py_CLEAR(result);
+                break;
+            }
+            PyList_SET_ITEM(result, r - old, index);
+        }
+    }
+    if (result && Coverings_grow(self) < 0)
+        Py_CLEAR(result);
+
+    if (!result) {
+        for (r = self->rowCount - 1; r >= old; r--)
+            Coverings_drop_row(self, r);
+        self->rowCount = old;
+        Coverings_drop_new_columns(self);
+    }
+    Coverings_rewind(self, prefix);
+    return result;
+}
+
+static char Coverings_remove_rows__doc__[] =
+"remove_rows(indices)\n"
+"\n"
+"Remove the rows with the given indices.  The indices of the other rows\n"
+"do not change, and elements left with no rows are still to be covered.\n"
+"The iteration starts over with the next call to next(), keeping the\n"
+"prefix, whose rows cannot be removed.  Does not support symmetries,\n"
+"costs or row_key, nor a matrix simplified by reduce().\n";
+
+/* .remove_rows() */
+static PyObject *
+Coverings_remove_rows(Coverings *self, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = {"indices", NULL};
+    PyObject *indices;
+    PyObject *fast;
+    Element **prefix;
+    int *rows = NULL;
+    Py_ssize_t count;
+    Py_ssize_t i;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O:remove_rows", kwlist,
+                                     &indices))
+        return NULL;
+    if (!Coverings_can_edit(self, "remove_rows"))
+        return NULL;
+    if (!(fast = PySequence_Fast(indices, "indices must be a sequence")))
+        return NULL;
+    count = PySequence_Fast_GET_SIZE(fast);
+    if (!(rows = PyMem_New(int, count + 1))) {
+        PyErr_NoMemory();
+        goto error;
+    }
+    for (i = 0; i < count; i++) {
+        long index = PyInt_AsLong(PySequence_Fast_GET_ITEM(fast, i));
+        if (index == -1 && PyErr_Occurred())
+            goto error;
+        if (index < 0 || index >= self->rowCount || !self->rows[index]) {
+            PyErr_Format(PyExc_ValueError, "no row %ld", index);
+            goto error;
+        }
+        rows[i] = (int)index;
+    }
+
+    qsort(rows, count, sizeof(int), compare_ints);
+    for (i = 0; i < self->base; i++) {
+        int row = self->solution[i]->row;
+        if (bsearch(&row, rows, count, sizeof(int), compare_ints)) {
+            PyErr_SetString(PyExc_ValueError,
+                            "cannot remove a row of the prefix");
+            goto error;
+        }
+    }
+
+    if (Coverings_unwind(self, &prefix) < 0)
+        goto error;
+    for (i = 0; i < count; i++)
+        Coverings_drop_row(self, rows[i]);
+    Coverings_rewind(self, prefix);
+
+    PyMem_Del(rows);
+    Py_DECREF(fast);
+    Py_RETURN_NONE;
+
+error:
+    PyMem_Del(rows);
+    Py_DECREF(fast);
+    return NULL;
+}
+
+static char Coverings_resolve__doc__[] =
+"resolve() -> covering or None\n"
+"\n"
+"Find a covering of the rows as they are now, starting from where the\n"
+"search was when they were last changed.  As much of that path as the\n"
+"changes left possible is followed again, so if the covering last\n"
+"produced survived, it is found at once, and otherwise the search goes\n"
+"on from the deepest part of it still valid.  Only if nothing is found\n"
+"from there is the whole search run from the start.  Returns None if\n"
+"there are no coverings.\n"
+"\n"
+"The path to the covering found is kept for the next call.  Iteration\n"
+"is not affected: the next call to next() starts from the beginning.\n"
+"The cells engine always runs the whole search.\n";
+
+/* .resolve() */
+static PyObject *
+Coverings_resolve(Coverings *self)
+{
+    PyObject *result = NULL;
+    Element **prefix;
+    int outcome;
+    int i;
+
+    if (!Coverings_has_matrix(self, "resolve"))
+        return NULL;
+    if (Coverings_unwind(self, &prefix) < 0)
+        return NULL;
+    Coverings_rewind(self, prefix);
+    if (Coverings_start(self) < 0)
+        return NULL;
+
+    /* Follow the trail as far as the rows still allow. */
+    for (i = 0; !self->cells && i < self->trailSize; i += 2) {
+        if (Coverings_replay(self, self->trail[i], self->trail[i + 1],
+                             1) < 0) {
+            PyErr_Clear();
+            break;
+        }
+    }
+
+    /* What was passed over on the way is searched from the start. */
+    outcome = Coverings_search(self, NULL);
+    if (outcome == SEARCH_DONE && i > 0)
+        outcome = Coverings_search(self, NULL);
+
+    if (outcome == SEARCH_FOUND) {
+        if (!(result = Coverings_found(self)))
+            return NULL;
+    } else {
+        Py_INCREF(Py_None);
+        result = Py_None;
+    }
+
+    /* Keep the path, and leave iteration to start over. */
+    if (Coverings_unwind(self, &prefix) < 0) {
+        Py_DECREF(result);
+        return NULL;
+    }
+    Coverings_rewind(self, prefix);
+    return result;
+}
+
+/* .tp_traverse */
+static int
+Coverings_traverse(Coverings *self, visitproc visit, void *arg)
+{
+    Element *e;
+    int i;
+
+    VISIT_TYPE(self);
+
+    /* Rows are never unlinked horizontally, so the row index reaches every
+     * element no matter how much of the matrix is covered. */
+    for (i = 0; i < self->rowCount; i++) {
+        Element *row = self->rows[i];
+        if (!row)
+            continue;
+        e = row;
+        do {
+            Py_VISIT(e->object);
+            e = e->right;
+        } while (e != row);
+    }
+
+    for (i = 0; i < self->itemCount; i++)
+        Py_VISIT(self->items[i]->object);
+    Py_VISIT(self->columns.dict);
+    Py_VISIT(self->colors);
+    for (i = 0; self->copies && i < self->rowCount; i++)
+        Py_VISIT(self->copies[i]);
+
+    return 0;
+}
+
+/* Resolve one entry of a row to its column and color.  An entry which is not
+ * itself a column, but is a pair (item, color) naming a secondary column, is
+ * a colored entry.  Returns -1 on failure. */
+static int
+Coverings_parse_entry(Coverings *self, PyObject *entry, Header **column,
+                      int *color)
+{
+    PyObject *colors = self->colors;
+    PyObject *name;
+    PyObject *number;
+    int found;
+
+    *color = 0;
+    *column = NULL;
+    found = lookup_column(&self->columns, self->corner, self->secondary,
+                          entry, column);
+    if (found == -1)
+        return -1;
+    else if (found == 1)
+        return 0;
+
+    if (!PyTuple_Check(entry) || PyTuple_GET_SIZE(entry) != 2 ||
+        (found = lookup_column(&self->columns, self->corner,
+                               self->secondary, PyTuple_GET_ITEM(entry, 0),
+                               column)) == 0 ||
+        (found == 1 && (*column)->bound >= 0)) {
+        /* A new primary column. */
+        *column = find_column(&self->columns, self->corner, self->secondary,
+                              entry, 0);
+        return *column ? 0 : -1;
+    } else if (found == -1) {
+        return -1;
+    }
+
+    /* Number the color. */
+    name = PyTuple_GET_ITEM(entry, 1);
+    if (!(number = PyDict_GetItem(colors, name))) {
+        if (PyErr_Occurred())
+            return -1;
+        number = PyInt_FromSsize_t(PyDict_Size(colors) + 1);
+        if (!number || PyDict_SetItem(colors, name, number) < 0) {
+            Py_XDECREF(number);
+            return -1;
         }
+        Py_DECREF(number);
     }
-    return -1;
+    *color = (int)PyInt_AsLong(number);
+    return 0;
 }
 
-/* Create a tuple of the current solution stack. */
-static PyObject *
-Coverings_solution(Coverings *self)
+/* Apply one (element, bound) pair of the bounds argument.  The bound is
+ * either a count, or a (min, max) pair. */
+static int
+Coverings_parse_bound(Coverings *self, PyObject *pair)
 {
-    PyObject *tuple;
-    int i;
+    Header *column;
+    PyObject *bound;
+    long u;
+    long v;
 
-    tuple = PyTuple_New(self->solutionSize);
-    if (!tuple)
-        return NULL;
+    if (!PyTuple_Check(pair) || PyTuple_GET_SIZE(pair) != 2) {
+        PyErr_SetString(PyExc_TypeError, "bounds must be a mapping");
+        return -1;
+    }
+    bound = PyTuple_GET_ITEM(pair, 1);
+    if (PyTuple_Check(bound)) {
+        if (!PyArg_ParseTuple(bound, "ll:bounds", &u, &v))
+            return -1;
+    } else {
+        u = v = PyInt_AsLong(bound);
+        if (u == -1 && PyErr_Occurred())
+            return -1;
+    }
+    if (u < 0 || v < 1 || u > v || v > INT_MAX / 2) {
+        PyErr_SetString(PyExc_ValueError,
+                        "bounds must satisfy 0 <= min <= max and max >= 1");
+        return -1;
+    }
 
-    for (i = 0; i < self->solutionSize; i++) {
-        PyObject *object = self->solution[i]->object;
-        Py_INCREF(object);
-        PyTuple_SET_ITEM(tuple, i, object);
+    if (!(column = find_column(&self->columns, self->corner,
+                               self->secondary, PyTuple_GET_ITEM(pair, 0),
+                               0)))
+        return -1;
+    if (column->bound < 0) {
+        PyErr_SetString(PyExc_ValueError,
+                        "secondary columns cannot have bounds");
+        return -1;
     }
-    return tuple;
+    column->bound = (int)v;
+    column->slack = (int)(v - u);
+    return 0;
 }
 
-static void
-Coverings_cleanup(Coverings *self)
+/* Rank the primary columns by the keys priorities maps them to.  Columns it
+ * leaves out come last.  Returns -1 on failure. */
+static int
+Coverings_parse_priorities(Coverings *self, PyObject *priorities)
 {
-    if (self->corner) {
-        /* restore matrix */
-        while (--self->solutionSize >= 0)
-            link_row(self->solution[self->solutionSize]);
+    PyObject *items = PyMapping_Items(priorities);
+    PyObject *pairs = NULL;
+    Header *column;
+    Py_ssize_t i;
+    int rank = 0;
+    int result = -1;
+
+    if (!items)
+        return -1;
+    if (!(pairs = PyList_New(0)))
+        goto done;
+    for (column = (Header *)self->corner->e.right; column != self->corner;
+         column = (Header *)column->e.right)
+        column->priority = -1;
+
+    /* Sort (key, index) pairs, so equal keys stay in column order. */
+    for (i = 0; i < PyList_GET_SIZE(items); i++) {
+        PyObject *item = PyList_GET_ITEM(items, i);
+        PyObject *pair;
+        int found;
+
+        if (!PyTuple_Check(item) || PyTuple_GET_SIZE(item) != 2) {
+            PyErr_SetString(PyExc_TypeError, "priorities must be a mapping");
+            goto done;
+        }
+        found = lookup_column(&self->columns, self->corner, self->secondary,
+                              PyTuple_GET_ITEM(item, 0), &column);
+        if (found < 0)
+            goto done;
+        if (!found || column->bound < 0) {
+            PyErr_SetString(PyExc_ValueError,
+                            "priorities must map primary elements");
+            goto done;
+        }
+        pair = Py_BuildValue("(Oi)", PyTuple_GET_ITEM(item, 1),
+                             column->index);
+        if (!pair || PyList_Append(pairs, pair) < 0) {
+            Py_XDECREF(pair);
+            goto done;
+        }
+        Py_DECREF(pair);
     }
+    if (PyList_Sort(pairs) < 0)
+        goto done;
 
-    free_matrix(self->corner);
-    PyMem_Del(self->solution);
-}
+    for (i = 0; i < PyList_GET_SIZE(pairs); i++) {
+        PyObject *pair = PyList_GET_ITEM(pairs, i);
+        if (i > 0) {
+            int cmp = PyObject_RichCompareBool(
+                PyTuple_GET_ITEM(PyList_GET_ITEM(pairs, i - 1), 0),
+                PyTuple_GET_ITEM(pair, 0), Py_EQ);
+            if (cmp < 0)
+                goto done;
+            rank += !cmp;
+        }
+        self->items[PyInt_AsLong(PyTuple_GET_ITEM(pair, 1))]->priority =
+            rank;
+    }
 
-/* .next() */
-static PyObject *
-Coverings_next(Coverings *self)
-{
-    /* We need to backup from the last solution on every new iteration. */
-    if (self->first) {
-        self->first = 0;
-    } else if (Coverings_backup(self) < 0) {
-        return NULL;
+    /* The rest come after. */
+    rank += PyList_GET_SIZE(pairs) > 0;
+    for (column = (Header *)self->corner->e.right; column != self->corner;
+         column = (Header *)column->e.right) {
+        if (column->priority < 0)
+            column->priority = rank;
     }
+    result = 0;
 
-    for (;;) {
-        int action = Coverings_step(self);
-        switch (action) {
-        case CONTINUE:
-            break;
+done:
+    Py_DECREF(items);
+    Py_XDECREF(pairs);
+    return result;
+}
 
-        case BACKUP:
-            if (Coverings_backup(self) < 0)
-                return NULL;
-            break;
+/* Read one cost per row from costs.  Returns -1 on failure. */
+static int
+Coverings_parse_costs(Coverings *self, PyObject *costs)
+{
+    PyObject *list = PySequence_Fast(costs, "costs must be a sequence");
+    int i;
 
-        case SOLUTION:
-            return Coverings_solution(self);
+    if (!list)
+        return -1;
+    if (PySequence_Fast_GET_SIZE(list) != self->rowCount) {
+        PyErr_SetString(PyExc_ValueError,
+                        "costs must have one entry per row");
+        goto error;
+    }
+    if (!(self->costs = PyMem_New(double, self->rowCount + 1))) {
+        PyErr_NoMemory();
+        goto error;
+    }
+    for (i = 0; i < self->rowCount; i++) {
+        double cost = PyFloat_AsDouble(PySequence_Fast_GET_ITEM(list, i));
+        if (cost == -1.0 && PyErr_Occurred())
+            goto error;
+        if (!(cost >= 0)) {
+            PyErr_SetString(PyExc_ValueError,
+                            "costs must not be negative");
+            goto error;
         }
+        self->costs[i] = cost;
     }
+    Py_DECREF(list);
+    return 0;
 
-    /* not reached. */
-    return NULL;
+error:
+    Py_DECREF(list);
+    return -1;
 }
 
-/* .tp_traverse */
+/* Lay out the rows of every column in the order of the keys rowKey gives
+ * their rows, keeping rows with equal keys in input order.  Every row must
+ * still be in its columns.  Returns -1 on failure. */
 static int
-Coverings_traverse(Coverings *self, visitproc visit, void *arg)
+Coverings_order_rows(Coverings *self, PyObject *rowKey)
 {
+    PyObject *pairs = PyList_New(0);
     Header *column;
-    Element *e;
+    int n;
     int i;
 
-    /* restore matrix */
-    for (i = self->solutionSize; i > 0; i--)
-        link_row(self->solution[i - 1]);
+    if (!pairs)
+        return -1;
+    for (i = 0; i < self->rowCount; i++) {
+        PyObject *key, *pair;
 
-    for (column = (Header *)self->corner->e.right; column != self->corner;
-         column = (Header *)column->e.right) {
-        for (e = column->e.down; e != &column->e; e = e->down) {
-            Py_VISIT(e->object);
+        /* Empty rows are in no column. */
+        if (!self->rows[i])
+            continue;
+        key = PyObject_CallFunctionObjArgs(rowKey, self->rows[i]->object,
+                                           NULL);
+        if (!key || !(pair = Py_BuildValue("(Ni)", key, i)))
+            goto error;
+        if (PyList_Append(pairs, pair) < 0) {
+            Py_DECREF(pair);
+            goto error;
         }
-        Py_VISIT(column->object);
+        Py_DECREF(pair);
     }
+    if (PyList_Sort(pairs) < 0)
+        goto error;
 
-    /* restore soluiton */
-    for (i = 0; i < self->solutionSize; i++)
-        unlink_row(self->solution[i]);
+    if (!(self->rowOrder = PyMem_New(int, self->rowCount + 1))) {
+        PyErr_NoMemory();
+        goto error;
+    }
+    for (n = 0; n < PyList_GET_SIZE(pairs); n++)
+        self->rowOrder[n] = (int)PyInt_AsLong(
+            PyTuple_GET_ITEM(PyList_GET_ITEM(pairs, n), 1));
+    for (i = 0; i < self->rowCount; i++) {
+        if (!self->rows[i])
+            self->rowOrder[n++] = i;
+    }
+    Py_DECREF(pairs);
 
+    /* Rebuild the column lists, appending rows in order. */
+    for (i = 0; i < self->itemCount; i++) {
+        column = self->items[i];
+        column->e.up = column->e.down = &column->e;
+    }
+    for (i = 0; i < self->rowCount; i++) {
+        Element *row = self->rows[self->rowOrder[i]];
+        Element *e = row;
+        if (!row)
+            continue;
+        do {
+            column = e->column;
+            e->up = column->e.up;
+            e->down = &column->e;
+            column->e.up->down = e;
+            column->e.up = e;
+            e = e->right;
+        } while (e != row);
+    }
     return 0;
+
+error:
+    Py_DECREF(pairs);
+    return -1;
 }
 
 /* .__init__() */
@@ -491,79 +5853,312 @@ Coverings_init(Coverings *self, PyObject *args, PyObject *kwds)
     PyObject *coverIt = NULL;
     PyObject *elem = NULL;
     PyObject *it = NULL;
+    PyObject *prefix = Py_None;
+    PyObject *secondary = Py_None;
+    PyObject *bounds = Py_None;
+    PyObject *symmetries = Py_None;
+    PyObject *seed = Py_None;
+    const char *restarts = NULL;
+    const char *heuristic = "smallest";
+    PyObject *priorities = Py_None;
+    PyObject *rowKey = Py_None;
+    PyObject *costs = Py_None;
+    PyObject *boundItems = NULL;
+    const char *engine = "links";
+    const char *duplicates = "keep";
+    const char *relayout = NULL;
+    Header *column;
+    long capacity;
+    static char *kwlist[] = {"iterable", "prefix", "secondary", "bounds",
+                             "engine", "symmetries", "seed", "restarts",
+                             "heuristic", "priorities", "row_key", "costs",
+                             "duplicates", "relayout", NULL};
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|OOOsOOzsOOOsz:Coverings",
+                                     kwlist, &covers, &prefix, &secondary,
+                                     &bounds, &engine, &symmetries, &seed,
+                                     &restarts, &heuristic, &priorities,
+                                     &rowKey, &costs, &duplicates,
+                                     &relayout))
+        goto error;
+
+    Coverings_cleanup(self);
 
-    if (kwds && PyDict_Size(kwds) != 0) {
-        PyErr_Format(PyExc_TypeError,
-                     "Coverings does not take keyword arguments");
+    if (strcmp(engine, "links") == 0) {
+        self->engine = ENGINE_LINKS;
+    } else if (strcmp(engine, "cells") == 0) {
+        self->engine = ENGINE_CELLS;
+    } else {
+        PyErr_Format(PyExc_ValueError, "unknown engine '%.100s'", engine);
         goto error;
     }
-    if (!PyArg_ParseTuple(args, "O:Coverings", &covers))
+
+    if (strcmp(heuristic, "smallest") == 0) {
+        self->heuristic = HEURISTIC_SMALLEST;
+    } else if (strcmp(heuristic, "weighted") == 0 ||
+               strcmp(heuristic, "priority") == 0) {
+        self->heuristic = heuristic[0] == 'w' ? HEURISTIC_WEIGHTED
+                                              : HEURISTIC_PRIORITY;
+        if (self->engine != ENGINE_LINKS) {
+            PyErr_Format(PyExc_ValueError,
+                         "the %s heuristic requires the links engine",
+                         heuristic);
+            goto error;
+        }
+    } else {
+        PyErr_Format(PyExc_ValueError, "unknown heuristic '%.100s'",
+                     heuristic);
         goto error;
+    }
 
-    Coverings_cleanup(self);
+    if (seed != Py_None) {
+        PyObject *number = PyNumber_Long(seed);
+        if (!number)
+            goto error;
+        self->random = PyLong_AsUnsignedLongMask(number) & 0xffffffffUL;
+        Py_DECREF(number);
+        if (PyErr_Occurred())
+            goto error;
+        self->random = (self->random * 2654435761UL + 1) & 0xffffffffUL;
+        if (!self->random)
+            self->random = 1;
+        if (self->engine != ENGINE_LINKS) {
+            PyErr_SetString(PyExc_ValueError,
+                            "seed requires the links engine");
+            goto error;
+        }
+    }
+    if (restarts) {
+        if (strcmp(restarts, "luby") == 0) {
+            self->restarts = RESTART_LUBY;
+        } else if (strcmp(restarts, "geometric") == 0) {
+            self->restarts = RESTART_GEOMETRIC;
+        } else {
+            PyErr_Format(PyExc_ValueError, "unknown restarts '%.100s'",
+                         restarts);
+            goto error;
+        }
+        if (seed == Py_None) {
+            PyErr_SetString(PyExc_ValueError, "restarts require a seed");
+            goto error;
+        }
+        self->run = 1;
+        self->budget = RESTART_UNIT;
+    }
+
+    if (strcmp(duplicates, "keep") == 0) {
+        self->duplicates = DUPLICATES_KEEP;
+    } else if (strcmp(duplicates, "expand") == 0) {
+        self->duplicates = DUPLICATES_EXPAND;
+    } else if (strcmp(duplicates, "count") == 0) {
+        self->duplicates = DUPLICATES_COUNT;
+    } else {
+        PyErr_Format(PyExc_ValueError, "unknown duplicates '%.100s'",
+                     duplicates);
+        goto error;
+    }
+    if (relayout && strcmp(relayout, "count") != 0 &&
+        strcmp(relayout, "rcm") != 0) {
+        PyErr_Format(PyExc_ValueError, "unknown relayout '%.100s'",
+                     relayout);
+        goto error;
+    }
 
     self->corner = alloc_matrix();
     if (!self->corner)
         goto error;
-
-    if (!(coverIt = PyObject_GetIter(covers)))
+    self->secondary = alloc_matrix();
+    if (!self->secondary)
+        goto error;
+    if (!(self->columns.dict = PyDict_New()) ||
+        !(self->colors = PyDict_New()))
         goto error;
-    while ((cover = PyIter_Next(coverIt))) {
-        Element *row = NULL;
 
-        if (!(it = PyObject_GetIter(cover)))
+    /* Secondary columns are created up front, so rows can refer to them. */
+    if (secondary != Py_None) {
+        if (!(it = PyObject_GetIter(secondary)))
             goto error;
         while ((elem = PyIter_Next(it))) {
-            Element *e = NULL;
-            Header *column = find_column(self->corner, elem);
-            if (!column)
+            if (!(column = find_column(&self->columns, self->corner,
+                                       self->secondary, elem, 1)))
                 goto error;
+            Py_CLEAR(elem);
+        }
+        Py_CLEAR(it);
+        if (PyErr_Occurred())
+            goto error;
+    }
 
-            /* Create element */
-            e = PyMem_New(Element, 1);
-            if (!e) {
-                PyErr_NoMemory();
+    /* So are bounded columns. */
+    if (bounds != Py_None) {
+        if (!(boundItems = PyMapping_Items(bounds)))
+            goto error;
+        if (!(it = PyObject_GetIter(boundItems)))
+            goto error;
+        while ((elem = PyIter_Next(it))) {
+            if (Coverings_parse_bound(self, elem) < 0)
                 goto error;
-            }
-            e->column = column;
-            Py_INCREF(cover);
-            e->object = cover;
-            column->count++;
-
-            /* Link into column */
-            e->up = column->e.up;
-            e->down = &column->e;
-            column->e.up->down = e;
-            column->e.up = e;
-
-            /* Link into row */
-            if (row == NULL) {
-                row = e;
-                e->left = e;
-                e->right = e;
-            } else {
-                e->left = row->left;
-                e->right = row;
-                row->left->right = e;
-                row->left = e;
-            }
-
             Py_CLEAR(elem);
         }
         Py_CLEAR(it);
+        Py_CLEAR(boundItems);
+        if (PyErr_Occurred())
+            goto error;
+    }
+
+    if (!(coverIt = PyObject_GetIter(covers)))
+        goto error;
+    while ((cover = PyIter_Next(coverIt))) {
+        if (Coverings_append_row(self, cover) < 0)
+            goto error;
         Py_CLEAR(cover);
     }
     Py_CLEAR(coverIt);
+    if (PyErr_Occurred())
+        goto error;
 
     CHECK(self->corner);
 
+    /* Number the columns, primary first. */
+    self->items = PyMem_New(Header *, column_count(self->corner) +
+                                      column_count(self->secondary) + 1);
+    if (!self->items) {
+        PyErr_NoMemory();
+        goto error;
+    }
+    for (column = (Header *)self->corner->e.right; column != self->corner;
+         column = (Header *)column->e.right) {
+        column->index = self->itemCount;
+        self->items[self->itemCount++] = column;
+    }
+    for (column = (Header *)self->secondary->e.right;
+         column != self->secondary;
+         column = (Header *)column->e.right) {
+        column->index = self->itemCount;
+        self->items[self->itemCount++] = column;
+    }
+
+    /* Every level of the search either covers a column once more, or
+     * finishes it. */
+    capacity = self->itemCount;
+    for (column = (Header *)self->corner->e.right; column != self->corner;
+         column = (Header *)column->e.right) {
+        if (column->bound != 1 || column->slack != 0)
+            self->multiplicity = 1;
+        capacity += column->bound;
+    }
+    if (capacity > INT_MAX) {
+        PyErr_SetString(PyExc_OverflowError, "bounds are too large");
+        goto error;
+    }
+    if (self->multiplicity && self->engine != ENGINE_LINKS) {
+        PyErr_SetString(PyExc_ValueError,
+                        "bounds require the links engine");
+        goto error;
+    }
+
+    /* A merged row is taken once at most, while a bounded column may take
+     * several identical rows. */
+    if (self->duplicates != DUPLICATES_KEEP) {
+        if (self->multiplicity || costs != Py_None ||
+            symmetries != Py_None) {
+            PyErr_SetString(PyExc_ValueError, "merging duplicates does not "
+                            "support bounds, costs or symmetries");
+            goto error;
+        }
+        if (Coverings_merge_rows(self) < 0)
+            goto error;
+    }
+
     self->first = 1;
-    self->solution = PyMem_New(Element *, column_count(self->corner));
+    self->solutionCapacity = (int)capacity;
+    self->solution = PyMem_New(Element *, self->solutionCapacity);
     self->solutionSize = 0;
     if (!self->solution) {
         PyErr_NoMemory();
         goto error;
     }
+    if (self->multiplicity) {
+        self->tweaks = PyMem_New(Element *, self->rowCount + 1);
+        self->tweakBase = PyMem_New(int, self->solutionCapacity);
+        if (!self->tweaks || !self->tweakBase) {
+            PyErr_NoMemory();
+            goto error;
+        }
+    }
+
+    if (priorities != Py_None) {
+        if (self->engine != ENGINE_LINKS) {
+            PyErr_SetString(PyExc_ValueError,
+                            "priorities require the links engine");
+            goto error;
+        }
+        if (Coverings_parse_priorities(self, priorities) < 0)
+            goto error;
+    } else if (self->heuristic == HEURISTIC_PRIORITY) {
+        PyErr_SetString(PyExc_ValueError,
+                        "the priority heuristic requires priorities");
+        goto error;
+    }
+    if (rowKey != Py_None) {
+        if (self->random) {
+            PyErr_SetString(PyExc_ValueError,
+                            "row_key and seed cannot be combined");
+            goto error;
+        }
+        if (Coverings_order_rows(self, rowKey) < 0)
+            goto error;
+    }
+    if (self->random) {
+        self->scratch = PyMem_New(Element *, self->rowCount + 1);
+        self->saved = PyMem_New(Element *, self->solutionCapacity + 1);
+        if (!self->scratch || !self->saved) {
+            PyErr_NoMemory();
+            goto error;
+        }
+        Coverings_shuffle(self);
+    }
+
+    if (costs != Py_None && Coverings_parse_costs(self, costs) < 0)
+        goto error;
+
+    if (symmetries != Py_None) {
+        if (prefix != Py_None || self->colored || self->multiplicity) {
+            PyErr_SetString(PyExc_ValueError, "symmetries do not support "
+                            "a prefix, colors or bounds");
+            goto error;
+        }
+        if (Coverings_symmetries(self, symmetries) < 0)
+            goto error;
+    }
+
+    /* The columns are packed last, in the order the rows were left in. */
+    if (relayout && Coverings_relayout(self, relayout) < 0)
+        goto error;
+
+    /* Restrict the search to the subtree below prefix. */
+    if (prefix != Py_None) {
+        if (!(it = PyObject_GetIter(prefix)))
+            goto error;
+        while ((elem = PyIter_Next(it))) {
+            long index = PyInt_AsLong(elem);
+            if (index == -1 && PyErr_Occurred())
+                goto error;
+            if (index >= 0 && index < self->rowCount && self->merged)
+                index = self->merged[index];
+            if (index < 0 || index >= self->rowCount ||
+                !Coverings_choose(self, self->rows[index])) {
+                PyErr_SetString(PyExc_ValueError,
+                                "prefix is not a partial covering");
+                goto error;
+            }
+            Py_CLEAR(elem);
+        }
+        Py_CLEAR(it);
+        if (PyErr_Occurred())
+            goto error;
+        self->base = self->solutionSize;
+    }
 
     return 0;
 
@@ -572,6 +6167,7 @@ error:
     Py_XDECREF(coverIt);
     Py_XDECREF(elem);
     Py_XDECREF(it);
+    Py_XDECREF(boundItems);
     return -1;
 }
 
@@ -579,12 +6175,103 @@ error:
 static void
 Coverings_dealloc(Coverings *self)
 {
+    PyTypeObject *type = Py_TYPE((PyObject *)self);
+
+    PyObject_GC_UnTrack(self);
     Coverings_cleanup(self);
-    Py_TYPE((PyObject *)self)->tp_free((PyObject *)self);
+    type->tp_free((PyObject *)self);
+    RELEASE_TYPE(type);
+}
+
+LOCKED_KWARGS(Coverings_init, Coverings, int)
+LOCKED_NOARGS(Coverings_next, Coverings)
+LOCKED_NOARGS(Coverings_checkpoint, Coverings)
+LOCKED_KWARGS(Coverings_split, Coverings, PyObject *)
+LOCKED_KWARGS(Coverings_fork, Coverings, PyObject *)
+LOCKED_KWARGS(Coverings_add_rows, Coverings, PyObject *)
+LOCKED_KWARGS(Coverings_remove_rows, Coverings, PyObject *)
+LOCKED_NOARGS(Coverings_resolve, Coverings)
+LOCKED_NOARGS(Coverings_share, Coverings)
+LOCKED_NOARGS(Coverings_zdd, Coverings)
+LOCKED_KWARGS(Coverings_count, Coverings, PyObject *)
+LOCKED_NOARGS(Coverings_reduce, Coverings)
+LOCKED_NOARGS(Coverings_best, Coverings)
+
+static PyMethodDef Coverings_methods[] = {
+    { "checkpoint", (PyCFunction)Coverings_checkpoint_locked, METH_NOARGS,
+      Coverings_checkpoint__doc__ },
+    { "resume", (PyCFunction)Coverings_resume,
+      METH_VARARGS | METH_KEYWORDS | METH_CLASS, Coverings_resume__doc__ },
+    { "split", (PyCFunction)Coverings_split_locked,
+      METH_VARARGS | METH_KEYWORDS,
+      Coverings_split__doc__ },
+    { "fork", (PyCFunction)Coverings_fork_locked,
+      METH_VARARGS | METH_KEYWORDS,
+      Coverings_fork__doc__ },
+    { "share", (PyCFunction)Coverings_share_locked, METH_NOARGS,
+      Coverings_share__doc__ },
+    { "add_rows", (PyCFunction)Coverings_add_rows_locked,
+      METH_VARARGS | METH_KEYWORDS,
+      Coverings_add_rows__doc__ },
+    { "remove_rows", (PyCFunction)Coverings_remove_rows_locked,
+      METH_VARARGS | METH_KEYWORDS,
+      Coverings_remove_rows__doc__ },
+    { "resolve", (PyCFunction)Coverings_resolve_locked, METH_NOARGS,
+      Coverings_resolve__doc__ },
+    { "attach", (PyCFunction)Coverings_attach,
+      METH_VARARGS | METH_KEYWORDS | METH_CLASS, Coverings_attach__doc__ },
+    { "zdd", (PyCFunction)Coverings_zdd_locked, METH_NOARGS,
+      Coverings_zdd__doc__ },
+    { "count", (PyCFunction)Coverings_count_locked,
+      METH_VARARGS | METH_KEYWORDS,
+      Coverings_count__doc__ },
+    { "reduce", (PyCFunction)Coverings_reduce_locked, METH_NOARGS,
+      Coverings_reduce__doc__ },
+    { "best", (PyCFunction)Coverings_best_locked, METH_NOARGS,
+      Coverings_best__doc__ },
+    { "portfolio", (PyCFunction)Coverings_portfolio,
+      METH_VARARGS | METH_KEYWORDS | METH_CLASS,
+      Coverings_portfolio__doc__ },
+    { NULL }
+};
+
+/* .nodes */
+static PyObject *
+Coverings_get_nodes(Coverings *self, void *closure)
+{
+    return PyLong_FromUnsignedLongLong(self->steps);
 }
 
-static const long Coverings_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC;
+static PyGetSetDef Coverings_getset[] = {
+    { "nodes", (getter)Coverings_get_nodes, NULL,
+      "Number of search steps taken by iteration so far." },
+    { NULL }
+};
+
+#if PY_MAJOR_VERSION >= 3
+static PyType_Slot Coverings_slots[] = {
+    { Py_tp_dealloc, (void *)Coverings_dealloc },
+    { Py_tp_hash, (void *)PyObject_HashNotImplemented },
+    { Py_tp_doc, (void *)Coverings__doc__ },
+    { Py_tp_traverse, (void *)Coverings_traverse },
+    { Py_tp_iter, (void *)PyObject_SelfIter },
+    { Py_tp_iternext, (void *)Coverings_next_locked },
+    { Py_tp_methods, (void *)Coverings_methods },
+    { Py_tp_getset, (void *)Coverings_getset },
+    { Py_tp_init, (void *)Coverings_init_locked },
+    { Py_tp_alloc, (void *)PyType_GenericAlloc },
+    { Py_tp_new, (void *)PyType_GenericNew },
+    { 0, NULL }
+};
 
+static PyType_Spec Coverings_spec = {
+    "exactcover.Coverings",
+    sizeof(Coverings),
+    0,
+    Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC | Py_TPFLAGS_IMMUTABLETYPE,
+    Coverings_slots
+};
+#else
 static PyTypeObject Coverings_Type = {
     PyObject_HEAD_INIT(NULL)
     0,                                       /* ob_size */
@@ -613,16 +6300,16 @@ static PyTypeObject Coverings_Type = {
     0,                                       /* tp_richcompare */
     0,                                       /* tp_weaklistoffset */
     PyObject_SelfIter,                       /* tp_iter */
-    (iternextfunc)Coverings_next,            /* tp_iternext */
-    0,                                       /* tp_methods */
+    (iternextfunc)Coverings_next_locked,     /* tp_iternext */
+    Coverings_methods,                       /* tp_methods */
     0,                                       /* tp_members */
-    0,                                       /* tp_getset */
+    Coverings_getset,                        /* tp_getset */
     0,                                       /* tp_base */
     0,                                       /* tp_dict */
     0,                                       /* tp_descr_get */
     0,                                       /* tp_descr_set */
     0,                                       /* tp_dictoffset */
-    (initproc)Coverings_init,                /* tp_init */
+    (initproc)Coverings_init_locked,         /* tp_init */
     PyType_GenericAlloc,                     /* tp_alloc */
     PyType_GenericNew,                       /* tp_new */
     0,                                       /* tp_free */
@@ -634,6 +6321,7 @@ static PyTypeObject Coverings_Type = {
     0,                                       /* tp_weaklist */
     0                                        /* tp_del */
 };
+#endif
 
 /* ------------------------------------------------------------------------ *
  * Module init                                                              *
@@ -642,6 +6330,91 @@ static PyMethodDef exactcovermethods[] = {
     { NULL }
 };
 
+#if PY_MAJOR_VERSION >= 3
+/* Py_mod_exec: create this module's types. */
+static int
+exactcover_exec(PyObject *module)
+{
+    ModuleState *state = (ModuleState *)PyModule_GetState(module);
+
+    state->CoveringsType = (PyTypeObject *)PyType_FromModuleAndSpec(
+        module, &Coverings_spec, NULL);
+    if (!state->CoveringsType)
+        return -1;
+    state->ZDDType = (PyTypeObject *)PyType_FromModuleAndSpec(
+        module, &ZDD_spec, NULL);
+    if (!state->ZDDType)
+        return -1;
+    state->ZDDIterType = (PyTypeObject *)PyType_FromModuleAndSpec(
+        module, &ZDDIter_spec, NULL);
+    if (!state->ZDDIterType)
+        return -1;
+
+    if (PyModule_AddObjectRef(module, "Coverings",
+                              (PyObject *)state->CoveringsType) < 0 ||
+        PyModule_AddObjectRef(module, "ZDD",
+                              (PyObject *)state->ZDDType) < 0)
+        return -1;
+    return 0;
+}
+
+static int
+exactcover_traverse(PyObject *module, visitproc visit, void *arg)
+{
+    ModuleState *state = (ModuleState *)PyModule_GetState(module);
+
+    Py_VISIT(state->CoveringsType);
+    Py_VISIT(state->ZDDType);
+    Py_VISIT(state->ZDDIterType);
+    return 0;
+}
+
+static int
+exactcover_clear(PyObject *module)
+{
+    ModuleState *state = (ModuleState *)PyModule_GetState(module);
+
+    Py_CLEAR(state->CoveringsType);
+    Py_CLEAR(state->ZDDType);
+    Py_CLEAR(state->ZDDIterType);
+    return 0;
+}
+
+static void
+exactcover_free(void *module)
+{
+    exactcover_clear((PyObject *)module);
+}
+
+static PyModuleDef_Slot exactcover_slots[] = {
+    { Py_mod_exec, (void *)exactcover_exec },
+#ifdef Py_MOD_PER_INTERPRETER_GIL_SUPPORTED
+    { Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED },
+#endif
+#ifdef Py_mod_gil
+    { Py_mod_gil, Py_MOD_GIL_NOT_USED },
+#endif
+    { 0, NULL }
+};
+
+static struct PyModuleDef exactcover_module = {
+    PyModuleDef_HEAD_INIT,
+    "exactcover",
+    exactcover__doc__,
+    sizeof(ModuleState),
+    exactcovermethods,
+    exactcover_slots,
+    exactcover_traverse,
+    exactcover_clear,
+    exactcover_free
+};
+
+PyMODINIT_FUNC
+PyInit_exactcover(void)
+{
+    return PyModuleDef_Init(&exactcover_module);
+}
+#else
 PyMODINIT_FUNC initexactcover(void)
 {
     PyObject *module = Py_InitModule3("exactcover", exactcovermethods,
@@ -649,11 +6422,18 @@ PyMODINIT_FUNC initexactcover(void)
     if (!module)
         return;
 
-    if (PyType_Ready(&Coverings_Type) < 0)
+    if (PyType_Ready(&Coverings_Type) < 0 ||
+        PyType_Ready(&ZDD_Type) < 0 ||
+        PyType_Ready(&ZDDIter_Type) < 0)
         return;
 
     Py_INCREF(&Coverings_Type);
     if (PyModule_AddObject(module,
                            "Coverings", (PyObject *)&Coverings_Type) < 0)
         return;
+
+    Py_INCREF(&ZDD_Type);
+    if (PyModule_AddObject(module, "ZDD", (PyObject *)&ZDD_Type) < 0)
+        return;
 }
+#endif
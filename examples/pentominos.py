@@ -35,6 +35,9 @@ subsets.
 There are 520 tilings (65 if we eliminate reflections and rotations).
 
 """
+from __future__ import print_function
+
+import itertools
 import pprint
 
 import exactcover
@@ -95,8 +98,8 @@ def positions(shape, width, height, world):
     'width' and 'height' are the maximum extents of world.
 
     """
-    for y in xrange(height):
-        for x in xrange(width):
+    for y in range(height):
+        for x in range(width):
             new_shape = [(x + xx, y + yy) for xx, yy in shape]
             if set(new_shape).issubset(world):
                 yield new_shape
@@ -108,7 +111,7 @@ def board():
     The board is a standard 8x8 chess board with the center 4 squares removed.
 
     """
-    b = set((x, y) for x in xrange(8) for y in xrange(8)
+    b = set((x, y) for x in range(8) for y in range(8)
             if not (3 <= x < 5 and 3 <= y < 5))
     return b
 
@@ -118,16 +121,36 @@ def matrix():
     b = board()
 
     covers = []
-    for name, shape in pentominos.iteritems():
+    for name, shape in pentominos.items():
         for rotation in rotations(shape):
             for position in positions(rotation, 8, 8, b):
                 covers.append([name] + sorted(position))
     return covers
 
 
+def symmetries():
+    """List permutations of the universe generating the board's symmetries.
+
+    Squares are rotated and reflected about the center of the board; the
+    pentominos map to themselves.
+
+    """
+    def rotate(element):
+        if isinstance(element, tuple):
+            x, y = element
+            return (7 - y, x)
+        return element
+    def reflect(element):
+        if isinstance(element, tuple):
+            x, y = element
+            return (7 - x, y)
+        return element
+    return [rotate, reflect]
+
+
 def solution_str(solution):
     """Turn a covering into a string picture representation."""
-    grid = [[' ' for i in xrange(8)] for j in xrange(8)]
+    grid = [[' ' for i in range(8)] for j in range(8)]
 
     # Mark unoccupied squares.
     for x, y in board():
@@ -145,17 +168,33 @@ def solution_str(solution):
 def main():
     m = matrix()
 
-    print "Example covering:"
+    print("Example covering:")
     # Take the first result from the iterator.
-    solution = exactcover.Coverings(m).next()
+    solution = next(exactcover.Coverings(m))
     pprint.pprint(solution)
-    print
-    print solution_str(solution)
-    print
+    print()
+    print(solution_str(solution))
+    print()
 
     # Count the number of results returned by the iterator.
-    print "There are {0} unique tilings.".format(
-        sum(1 for x in exactcover.Coverings(m)))
+    print("There are {0} unique tilings.".format(
+        sum(1 for x in exactcover.Coverings(m))))
+
+    # With the symmetries, only one tiling of each orbit is produced.
+    print("There are {0} up to rotation and reflection.".format(
+        sum(1 for x in exactcover.Coverings(m, symmetries=symmetries()))))
+
+    # Split the search into pieces, stop each one after its first tiling and
+    # resume it from a checkpoint; between them they still find every one.
+    found = 0
+    for prefix in exactcover.Coverings(m).split(jobs=4):
+        coverings = exactcover.Coverings(m, prefix=prefix)
+        found += sum(1 for x in itertools.islice(coverings, 1))
+        checkpoint = coverings.checkpoint()
+        found += sum(1 for x in exactcover.Coverings.resume(
+            m, checkpoint, prefix=prefix))
+    assert found == 520, found
+    print("Split and resumed, the search finds {0}.".format(found))
 
 
 if __name__ == '__main__':
@@ -18,10 +18,51 @@
 # OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 # THE SOFTWARE.
 
-from distutils.core import setup
-from distutils.extension import Extension
+import os
+import subprocess
+import sys
+try:
+    from setuptools import setup, Command, Extension
+except ImportError:
+    from distutils.core import setup, Command
+    from distutils.extension import Extension
 
-exactcover = Extension('exactcover', sources=['exactcover.c'])
+exactcover = Extension('exactcover', sources=['exactcover.c'],
+                       depends=['dlxlinks.h'])
+
+
+class benchmark(Command):
+    """Build the extension in place and run benchmark.py."""
+
+    description = 'run the benchmarks'
+    user_options = [
+        ('output=', 'o', 'write the results as JSON to this file'),
+        ('quick', 'q', 'only run the smaller instances'),
+    ]
+    boolean_options = ['quick']
+
+    def initialize_options(self):
+        self.output = None
+        self.quick = 0
+
+    def finalize_options(self):
+        pass
+
+    def run(self):
+        build_ext = self.reinitialize_command('build_ext')
+        build_ext.inplace = 1
+        self.run_command('build_ext')
+
+        args = [sys.executable, 'benchmark.py']
+        if self.output:
+            args += ['--output', self.output]
+        if self.quick:
+            args.append('--quick')
+        env = dict(os.environ)
+        env['PYTHONPATH'] = os.pathsep.join(
+            [os.getcwd()] + [p for p in [env.get('PYTHONPATH')] if p])
+        if subprocess.call(args, env=env) != 0:
+            raise SystemExit('benchmark failed')
 
 setup(name='ExactCover',
       version='0.1',
@@ -30,4 +71,5 @@ setup(name='ExactCover',
       url='http://github.com/kwaters/exactcover',
       description='Exact cover solver.',
       license='MIT',
-      ext_modules = [exactcover])
+      ext_modules = [exactcover],
+      cmdclass = {'benchmark': benchmark})